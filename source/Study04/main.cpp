@@ -7,8 +7,29 @@
 #include <thread>
 #include <algorithm>
 #include <cmath>
-
-#define USE_THREADS 1
+#include <functional>
+
+// one of these is COPY_MODE; all but COPY_MODE_TREE copy only the files directly in from
+#define COPY_MODE_SERIAL 0 // fs::copy_file, one file after another
+#define COPY_MODE_THREADS 1 // fs::copy_file, the files split evenly between threads
+#define COPY_MODE_ZERO_COPY 2 // as COPY_MODE_THREADS with reflink, copy_file_range or sendfile instead of fs::copy_file
+#define COPY_MODE_CHUNKED 3 // files one after another, each split into chunks copied by a thread_pool
+#define COPY_MODE_IO_URING 4 // all files at once through io_uring with a deep queue (the thread pool where not available)
+#define COPY_MODE_TREE 5 // the whole tree below from, listed in parallel, files dealt out to the thread pool by size
+
+#define COPY_MODE COPY_MODE_TREE
+// both off by default: hashing needs every copied file in user space, so USE_INCREMENTAL copies them buffered
+// instead of chunked or zero-copy, and VERIFY_COPY reads the whole destination once more after the timed copy
+#define USE_INCREMENTAL 0 // with COPY_MODE_TREE: keep the destination and skip unchanged files (size and time, then CRC32C)
+#define VERIFY_COPY 0 // with USE_INCREMENTAL: re-read the destination and compare it with the checksums taken while copying
+
+#if COPY_MODE == COPY_MODE_TREE
+#include "tree_copy.h"
+#elif COPY_MODE == COPY_MODE_IO_URING
+#include "batch_copy.h"
+#elif COPY_MODE == COPY_MODE_CHUNKED || COPY_MODE == COPY_MODE_ZERO_COPY
+#include "file_copy.h"
+#endif
 
 namespace fs = std::experimental::filesystem;
 
@@ -47,12 +68,30 @@ std::vector<fs::path> GetListOfFiles(const fs::path& path)
 void CopyFile(const fs::path& src, const fs::path& dst)
 {
     std::cout << "Copying " << src << " to " << dst << std::endl;
+#if COPY_MODE == COPY_MODE_CHUNKED
+    const auto result = CopyFileChunked(src.string(), dst.string());
+    std::cout << "  " << result.bytes << " bytes, " << CopyMethodName(result.method) << ", " << result.workers << " workers, "
+        << result.chunkSize / 1024 << "KB chunks" << std::endl;
+#elif COPY_MODE == COPY_MODE_ZERO_COPY
+    const auto result = CopyFileZeroCopy(src.string(), dst.string());
+    std::cout << "  " << result.bytes << " bytes, " << CopyMethodName(result.method) << std::endl;
+#else
     fs::copy_file(src, dst);
+#endif
 }
 
 void CopyFiles(const std::vector<fs::path>& files, const fs::path& dst)
 {
-#if USE_THREADS
+#if COPY_MODE == COPY_MODE_IO_URING
+    std::vector<batch_copy_task> tasks;
+    for (auto &file : files)
+    {
+        tasks.push_back({ file.string(), (dst / file.filename()).string() });
+    }
+    const auto result = CopyFilesBatched(tasks);
+    std::cout << result.files << " files, " << result.bytes << " bytes copied "
+        << (result.usedIoUring ? "through io_uring" : "on the thread pool, io_uring is not available") << std::endl;
+#elif COPY_MODE == COPY_MODE_THREADS || COPY_MODE == COPY_MODE_ZERO_COPY
     const auto fileCount = static_cast<unsigned int>(files.size());
     const auto numThreads = GetOptimalNumberOfThreads(fileCount);
 
@@ -86,6 +125,7 @@ void CopyFiles(const std::vector<fs::path>& files, const fs::path& dst)
 
     std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
 #else
+    // with COPY_MODE_CHUNKED the threads work on one file at a time, a single huge file keeps all of them busy
     for (auto &file : files)
     {
         CopyFile(file, dst / file.filename());
@@ -98,15 +138,50 @@ int main()
     const auto destPath = fs::path("to");
     const auto sourcePath = fs::path("from");
 
+#if COPY_MODE == COPY_MODE_TREE && USE_INCREMENTAL
+    // what an earlier run copied is kept, only what changed since is copied again
+    tree_copy_options options;
+    options.skip = tree_copy_skip::checksum;
+#else
     CleanDestinationFolder(destPath);
+#endif
+
+#if COPY_MODE == COPY_MODE_TREE
+    std::cout << "Copying the tree below " << fs::absolute(sourcePath) << std::endl;
+    const auto timeStart = std::chrono::high_resolution_clock::now();
+#if USE_INCREMENTAL
+    const auto result = CopyTree(thread_pool::Default(), sourcePath.string(), destPath.string(), options);
+    std::cout << result.skipped << " files unchanged" << std::endl;
+#else
+    const auto result = CopyTree(sourcePath.string(), destPath.string());
+#endif
+    std::cout << result.files << " files in " << result.directories << " directories, " << result.bytes << " bytes copied" << std::endl;
+    for (auto method = std::size_t(0); method < CopyMethodCount; ++method)
+    {
+        if (result.methods[method] != 0)
+        {
+            std::cout << "  " << result.methods[method] << " files by " << CopyMethodName(static_cast<copy_method>(method)) << std::endl;
+        }
+    }
+#else
     auto fileList = GetListOfFiles(sourcePath);
 
     const auto timeStart = std::chrono::high_resolution_clock::now();
     CopyFiles(fileList, destPath);
+#endif
     const auto timeEnd = std::chrono::high_resolution_clock::now();
 
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(timeEnd - timeStart);
     std::cout << "\n\nTotal transfer time: " << duration.count() * 0.000001f << "s" << std::endl;
 
+#if COPY_MODE == COPY_MODE_TREE && USE_INCREMENTAL && VERIFY_COPY
+    const auto mismatches = VerifyTree(destPath.string());
+    for (auto& file : mismatches)
+    {
+        std::cout << "  " << file << " does not match its checksum" << std::endl;
+    }
+    std::cout << "Verified, " << mismatches.size() << " files differ from what was written" << std::endl;
+#endif
+
     return 0;
 }
\ No newline at end of file
@@ -8,11 +8,25 @@
 
 #include <cassert>
 
+#include "node_pool.h"
+#include "quicksort.h"
+
 #define USE_PARALLEL 1
+#define USE_NODE_POOL 1
 #define ENABLE_PRINT 0
 #define NUM_ELEMENTS 1000
 
-void populate_sorted(std::list<int>& data, int numElements)
+// with the node pool, nodes (and the list heads some implementations allocate)
+// come from per-thread free lists instead of the global heap
+#if USE_NODE_POOL
+template <typename T>
+using sort_list = pool_list<T>;
+#else
+template <typename T>
+using sort_list = std::list<T>;
+#endif
+
+void populate_sorted(sort_list<int>& data, int numElements)
 {
     int i = 0;
     while (i < numElements)
@@ -22,7 +36,7 @@ void populate_sorted(std::list<int>& data, int numElements)
     }
 }
 
-void populate_random(std::list<int>& data, int numElements)
+void populate_random(sort_list<int>& data, int numElements)
 {
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -34,7 +48,7 @@ void populate_random(std::list<int>& data, int numElements)
     }
 }
 
-bool isSorted(const std::list<int>& data)
+bool isSorted(const sort_list<int>& data)
 {
     auto prev = data.begin();
     auto next = prev;
@@ -53,7 +67,7 @@ bool isSorted(const std::list<int>& data)
     return true;
 }
 
-void print(const std::list<int>& data)
+void print(const sort_list<int>& data)
 {
     std::for_each(data.begin(), data.end(), [](int d)
     {
@@ -63,20 +77,28 @@ void print(const std::list<int>& data)
 }
 
 template <typename T>
-std::list<T> quickSort(std::list<T>&& source)
+sort_list<T> quickSort(sort_list<T>&& source, unsigned int depthLimit)
 {
     if (source.size() <= 1)
     {
         return source;
     }
 
-    int pivotValue = source.front();
-    source.pop_front(); // memory deallocation
+    // bad pivots kept coming, stop recursing (and spawning threads)
+    if (depthLimit == 0)
+    {
+        source.sort();
+        return source;
+    }
+
+    // median of front, middle and back so sorted input still splits evenly
+    T pivotValue = MedianOfThree(source.front(), *std::next(source.begin(), source.size() / 2), source.back(), std::less<T>());
 
-    std::list<T> lower;
-    std::list<T> higher;
+    sort_list<T> lower;
+    sort_list<T> equal;
+    sort_list<T> higher;
 
-    // partitioning
+    // partitioning, three-way so duplicates of the pivot are done right away
     while (!source.empty())
     {
         auto it = source.begin();
@@ -84,25 +106,29 @@ std::list<T> quickSort(std::list<T>&& source)
         {
             lower.splice(lower.end(), source, it);
         }
-        else
+        else if (pivotValue < *it)
         {
             higher.splice(higher.end(), source, it);
         }
+        else
+        {
+            equal.splice(equal.end(), source, it);
+        }
     }
 
     assert(source.size() == 0);
 
     // recursion
 #if USE_PARALLEL
-    std::future<std::list<T>> newLower = std::async(quickSort<T>, std::move(lower));
+    std::future<sort_list<T>> newLower = std::async(quickSort<T>, std::move(lower), depthLimit - 1);
 #else
-    lower = quickSort(std::move(lower));
+    lower = quickSort(std::move(lower), depthLimit - 1);
 #endif
-    higher = quickSort(std::move(higher));
+    higher = quickSort(std::move(higher), depthLimit - 1);
 
     // merging
-    std::list<T> result;
-    result.push_back(pivotValue); // memory allocation
+    sort_list<T> result;
+    result.splice(result.end(), equal);
     result.splice(result.end(), higher);
 #if USE_PARALLEL
     result.splice(result.begin(), newLower.get());
@@ -115,7 +141,7 @@ std::list<T> quickSort(std::list<T>&& source)
 
 int main()
 {
-    std::list<int> source;
+    sort_list<int> source;
     populate_sorted(source, NUM_ELEMENTS);
     //populate_random(source, NUM_ELEMENTS);
 
@@ -125,7 +151,7 @@ int main()
 #endif
 
     auto startTime = std::chrono::high_resolution_clock::now();
-    source = quickSort(std::move(source));
+    source = quickSort(std::move(source), IntroSortDepthLimit(source.size()));
     auto stopTime = std::chrono::high_resolution_clock::now();
 
     std::cout << (isSorted(source) ? "sorted" : "not sorted") << std::endl;
@@ -5,7 +5,11 @@
 #include <chrono>
 #include <thread>
 
+#include "parallel_quicksort.h"
+#include "quicksort.h"
+
 #define USE_PARALLEL 1
+#define USE_WORK_STEALING 1 // fork-join on the thread_pool instead of a std::thread per partition
 #define ENABLE_PRINT 0
 #define NUM_ELEMENTS 1000
 
@@ -60,37 +64,38 @@ void print(const std::vector<int>& data)
 }
 
 template <class T, class size_type = typename std::vector<T>::size_type>
-void quickSort(std::vector<T>& source, size_type startIndex, size_type endIndex)
+void quickSort(std::vector<T>& source, size_type startIndex, size_type endIndex, unsigned int depthLimit)
 {
-    if (endIndex - startIndex <= 1)
+    auto first = source.begin() + startIndex;
+    auto last = source.begin() + endIndex;
+    if (endIndex - startIndex <= InsertionSortThreshold)
     {
+        InsertionSort(first, last, std::less<T>());
         return;
     }
 
-    T pivotValue = source[startIndex];
-    size_type pivotIndex = startIndex + 1;
-
-    // partitioning
-    for (auto i = pivotIndex; i < endIndex; ++i)
+    // bad pivots kept coming, stop recursing (and spawning threads)
+    if (depthLimit == 0)
     {
-        if (source[i] < pivotValue)
-        {
-            std::swap(source[i], source[pivotIndex]);
-            ++pivotIndex;
-        }
+        HeapSort(first, last, std::less<T>());
+        return;
     }
 
-    pivotIndex--;
-    std::swap(source[startIndex], source[pivotIndex]);
+    // partitioning, ninther pivot and three-way so sorted input and
+    // duplicates still split evenly
+    ChoosePivot(first, last, std::less<T>());
+    const auto equal = PartitionThreeWay(first, last, std::less<T>());
+    const size_type lowerEnd = equal.first - source.begin();
+    const size_type upperStart = equal.second - source.begin();
 
     // recursion
 #if USE_PARALLEL
-    std::thread lower(quickSort<T>, std::ref(source), startIndex, pivotIndex);
-    quickSort(source, pivotIndex + 1, endIndex);
+    std::thread lower(quickSort<T>, std::ref(source), startIndex, lowerEnd, depthLimit - 1);
+    quickSort(source, upperStart, endIndex, depthLimit - 1);
     lower.join();
 #else
-    quickSort(source, startIndex, pivotIndex);
-    quickSort(source, pivotIndex + 1, endIndex);
+    quickSort(source, startIndex, lowerEnd, depthLimit - 1);
+    quickSort(source, upperStart, endIndex, depthLimit - 1);
 #endif
 }
 
@@ -106,7 +111,11 @@ int main()
 #endif
 
     auto startTime = std::chrono::high_resolution_clock::now();
-    quickSort(source, (size_t)0, source.size());
+#if USE_PARALLEL && USE_WORK_STEALING
+    parallel_quicksort(thread_pool::Default(), source.begin(), source.end());
+#else
+    quickSort(source, (size_t)0, source.size(), IntroSortDepthLimit(source.size()));
+#endif
     auto stopTime = std::chrono::high_resolution_clock::now();
 
     std::cout << (isSorted(source) ? "sorted" : "not sorted") << std::endl;
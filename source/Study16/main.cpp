@@ -1,6 +1,5 @@
 #include <iostream>
 #include <vector>
-#include <queue>
 #include <algorithm>
 #include <random>
 #include <chrono>
@@ -9,9 +8,18 @@
 
 #include <cassert>
 
+#include "loser_tree.h"
+#include "parallel_merge.h"
+#include "quicksort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+#include "timer_wheel.h"
+
 #define USE_PARALLEL 1
+#define USE_PARALLEL_MERGE 1
 #define ENABLE_PRINT 0
 #define NUM_ELEMENTS 1000000
+#define SORT_TIMEOUT_MS 10000
 
 void populate_sorted(std::vector<int>& data, int numElements)
 {
@@ -63,100 +71,29 @@ void print(const std::vector<int>& data)
     std::cout << std::endl << std::endl;
 }
 
-std::vector<int> quickSort(std::vector<int>&& source, typename std::vector<int>::size_type startIndex, typename std::vector<int>::size_type endIndex)
+std::vector<int> quickSort(std::vector<int>&& source, typename std::vector<int>::size_type startIndex, typename std::vector<int>::size_type endIndex,
+    const stop_token& token = stop_token())
 {
-    typedef typename std::vector<int>::size_type size_type;
-    std::queue<size_type> lowHighIndices;
-    lowHighIndices.push(startIndex);
-    lowHighIndices.push(endIndex);
-
-    while (!lowHighIndices.empty())
-    {
-        auto low = lowHighIndices.front();
-        lowHighIndices.pop();
-        auto high = lowHighIndices.front();
-        lowHighIndices.pop();
-
-        if (high - low <= 1)
-        {
-            continue;
-        }
-
-        int pivotValue = source[low];
-        size_type pivotIndex = low + 1;
-
-        // partitioning
-        for (auto i = pivotIndex; i < high; ++i)
-        {
-            if (source[i] < pivotValue)
-            {
-                std::swap(source[i], source[pivotIndex]);
-                ++pivotIndex;
-            }
-        }
-
-        pivotIndex--;
-        std::swap(source[low], source[pivotIndex]);
-
-        lowHighIndices.push(low);
-        lowHighIndices.push(pivotIndex);
-
-        lowHighIndices.push(pivotIndex + 1);
-        lowHighIndices.push(high);
-    }
-
+    // ninther pivots, heapsort past 2 * log2(n) levels, three-way partitioning
+    // of duplicate runs; the token is checked at every partition
+    IntroSort(source.begin() + startIndex, source.begin() + endIndex, std::less<int>(), token);
     return source;
 }
 
-std::vector<int> mergeSortedLists(const std::vector<int>& a, const std::vector<int>& b)
-{
-    std::vector<int> result;
-    result.reserve(a.size() + b.size());
-    auto aIndex = 0u;
-    auto bIndex = 0u;
-
-    while (aIndex < a.size() || bIndex < b.size())
-    {
-        if (aIndex == a.size())
-        {
-            result.push_back(b[bIndex]);
-            bIndex++;
-        }
-        else if (bIndex == b.size())
-        {
-            result.push_back(a[aIndex]);
-            aIndex++;
-        }
-        else if (a[aIndex] < b[bIndex])
-        {
-            result.push_back(a[aIndex]);
-            aIndex++;
-        }
-        else
-        {
-            result.push_back(b[bIndex]);
-            bIndex++;
-        }
-    }
-
-    return result;
-}
-
 std::vector<int> mergeSortedLists(std::vector<std::vector<int>> sortedPartialLists)
 {
-    std::vector<int> result;
-
-    if (sortedPartialLists.size() < 1)
-    {
-        return result;
-    }
-
-    result = sortedPartialLists[0];
-    for (auto i = 1; i < sortedPartialLists.size(); ++i)
+    // one pass over all lists, log k comparisons per element
+    std::vector<std::pair<std::vector<int>::iterator, std::vector<int>::iterator>> runs;
+    auto totalSize = std::size_t(0);
+    for (auto& list : sortedPartialLists)
     {
-        result = std::move(mergeSortedLists(result, sortedPartialLists[i]));
+        runs.emplace_back(list.begin(), list.end());
+        totalSize += list.size();
     }
 
+    std::vector<int> result;
+    result.reserve(totalSize);
+    LoserTreeMerge(runs, [&result](int value) { result.push_back(value); }, std::less<int>());
     return result;
 }
 
@@ -171,6 +108,15 @@ int main()
     print(source);
 #endif
 
+    // give up on the sort instead of letting it run to completion after a timeout
+    stop_source cancelSort;
+    const auto token = cancelSort.GetToken();
+    timer_service timers;
+    timers.ScheduleAfter(std::chrono::milliseconds(SORT_TIMEOUT_MS), [cancelSort]() mutable
+    {
+        cancelSort.RequestStop();
+    });
+
     auto startTime = std::chrono::high_resolution_clock::now();
 #if USE_PARALLEL
     auto numThreads = std::thread::hardware_concurrency();
@@ -179,34 +125,55 @@ int main()
     std::cout << "Num Elements per Thread: " << numElementsPerThread << std::endl;
     auto low = source.begin();
 
+    auto& pool = thread_pool::Default();
     std::vector<std::future<std::vector<int>>> futurePartialLists;
     futurePartialLists.reserve(numThreads - 1); // main thread doesn't need a future
 
     for (auto i = 0u; i < numThreads - 1; ++i)
     {
         auto high = source.begin() + static_cast<int>( roundf( (i + 1) * numElementsPerThread ) );
-        futurePartialLists.emplace_back(std::async([low, high]
+        futurePartialLists.emplace_back(pool.Submit([low, high, token]
         {
             // low and high iterators are valid because source doesn't get modified until all portions are sorted
             auto partial = std::vector<int>(low, high);
-            return quickSort(std::move(partial), 0, partial.size());
-        }));
+            return quickSort(std::move(partial), 0, partial.size(), token);
+        }, token));
         low = high;
     }
 
     std::vector<std::vector<int>> sortedPartialLists;
     sortedPartialLists.resize(numThreads);
 
+    auto cancelled = false;
+    try
     {
         // main thread does work too
         auto partial = std::vector<int>(low, source.end());
-        sortedPartialLists[numThreads - 1] = quickSort(std::move(partial), 0, partial.size());
+        sortedPartialLists[numThreads - 1] = quickSort(std::move(partial), 0, partial.size(), token);
+    }
+    catch (const operation_cancelled&)
+    {
+        cancelled = true;
     }
 
-    // get all sorted portions
+    // get all sorted portions, even when cancelled the workers still read source
+    // so every one of them has to be waited on
     for (auto i = 0u; i < numThreads - 1; ++i)
     {
-        sortedPartialLists[i] = futurePartialLists[i].get();
+        try
+        {
+            sortedPartialLists[i] = futurePartialLists[i].get();
+        }
+        catch (const operation_cancelled&)
+        {
+            cancelled = true;
+        }
+    }
+
+    if (cancelled)
+    {
+        std::cout << "Sort cancelled after " << SORT_TIMEOUT_MS << "ms" << std::endl;
+        return 1;
     }
 
 #if ENABLE_PRINT
@@ -217,9 +184,36 @@ int main()
     });
 #endif
 
+#if USE_PARALLEL_MERGE
+    // every thread merges an equal slice of the output straight into source
+    std::vector<std::pair<std::vector<int>::iterator, std::vector<int>::iterator>> runs;
+    runs.reserve(sortedPartialLists.size());
+    for (auto& list : sortedPartialLists)
+    {
+        runs.emplace_back(list.begin(), list.end());
+    }
+    try
+    {
+        parallel_multiway_merge(pool, runs, source.begin(), std::less<int>(), token);
+    }
+    catch (const operation_cancelled&)
+    {
+        std::cout << "Sort cancelled after " << SORT_TIMEOUT_MS << "ms" << std::endl;
+        return 1;
+    }
+#else
     source = std::move(mergeSortedLists(std::move(sortedPartialLists)));
+#endif
 #else
-    source = std::move(quickSort(std::move(source), 0, source.size()));
+    try
+    {
+        source = std::move(quickSort(std::move(source), 0, source.size(), token));
+    }
+    catch (const operation_cancelled&)
+    {
+        std::cout << "Sort cancelled after " << SORT_TIMEOUT_MS << "ms" << std::endl;
+        return 1;
+    }
 #endif
 
     assert(source.size() == NUM_ELEMENTS);
@@ -7,8 +7,10 @@
 #include "matrix.h"
 
 #define USE_THREADS 1
+#define NUM_PEAKS 8
 
 #if USE_THREADS
+#include "parallel_select.h"
 #include "pfft.h"
 #else
 #include "fft.h"
@@ -92,14 +94,50 @@ matrix<double> GetMagnitudeSpectrum(const matrix<std::complex<double>>& data)
     return matrix<double>(data.Width(), data.Height(), std::move(magSpecData));
 }
 
+/*
+Largest magnitudes and the median magnitude, without sorting the whole spectrum
+*/
+#if USE_THREADS
+void PrintSpectrumPeaks(thread_pool& pool, const matrix<std::complex<double>>& data)
+#else
+void PrintSpectrumPeaks(const matrix<std::complex<double>>& data)
+#endif
+{
+    auto spectrum = GetMagnitudeSpectrum(data);
+    auto& magnitudes = spectrum.Raw();
+    const auto peaksLast = magnitudes.begin() + std::min<std::size_t>(NUM_PEAKS, magnitudes.size());
+    const auto median = magnitudes.begin() + magnitudes.size() / 2;
+#if USE_THREADS
+    parallel_nth_element(pool, magnitudes.begin(), median, magnitudes.end(), std::greater<>());
+    const auto medianMagnitude = *median;
+    parallel_partial_sort(pool, magnitudes.begin(), peaksLast, magnitudes.end(), std::greater<>());
+#else
+    std::nth_element(magnitudes.begin(), median, magnitudes.end(), std::greater<>());
+    const auto medianMagnitude = *median;
+    std::partial_sort(magnitudes.begin(), peaksLast, magnitudes.end(), std::greater<>());
+#endif
+
+    std::cout << "Spectrum peaks:";
+    std::for_each(magnitudes.begin(), peaksLast, [](double magnitude) { std::cout << " " << magnitude; });
+    std::cout << std::endl << "Median magnitude: " << medianMagnitude << std::endl;
+}
+
+#if USE_THREADS
+void CleanUpDataForImageWriting(thread_pool& pool, matrix<double>& data)
+#else
 void CleanUpDataForImageWriting(matrix<double>& data)
+#endif
 {
     data.Transform([](const double& el)
     {
         return log(el * 10.0 + 1) / log(1000.0);
     });
 
+#if USE_THREADS
+    data.Normalize(pool);
+#else
     data.Normalize();
+#endif
 }
 
 void WriteBMPToFile(BMP& image, const fs::path& path)
@@ -112,12 +150,20 @@ void WriteBMPToFile(BMP& image, const fs::path& path)
     }
 }
 
+#if USE_THREADS
+void WriteMatrixToImage(thread_pool& pool, const matrix<std::complex<double>>& data, const std::string& filename, bool cleanUp = true)
+#else
 void WriteMatrixToImage(const matrix<std::complex<double>>& data, const std::string& filename, bool cleanUp = true)
+#endif
 {
     auto magMatrix = GetMagnitudeSpectrum(data);
     if (cleanUp)
     {
+#if USE_THREADS
+        CleanUpDataForImageWriting(pool, magMatrix);
+#else
         CleanUpDataForImageWriting(magMatrix);
+#endif
     }
     auto magImage = ConvertFromMatrix(magMatrix);
     WriteBMPToFile(magImage, fs::path() / filename);
@@ -136,22 +182,34 @@ int main()
     RecenterMatrixDataForFFT(imageMatrix);
 
     matrix<std::complex<double>> intermediate;
+#if USE_THREADS
+    // workers pinned to cores, node by node, so PFFT's first-touched slabs stay local; everything else
+    // parallel runs on this pool too instead of an unpinned default one
+    thread_pool pool(GetHardwareThreadCount(), true);
+#endif
     auto startTime = std::chrono::high_resolution_clock::now();
 #if USE_THREADS
-    imageMatrix = PFFT(imageMatrix, intermediate);
+    imageMatrix = PFFT(pool, imageMatrix, intermediate);
 #else
     imageMatrix = FFT(imageMatrix, intermediate);
 #endif
     auto stopTime = std::chrono::high_resolution_clock::now();
     auto durationMS = std::chrono::duration<float, std::milli>(stopTime - startTime).count();
 
+#if USE_THREADS
+    WriteMatrixToImage(pool, intermediate, "fwd-byRow.bmp");
+    WriteMatrixToImage(pool, imageMatrix, "fwd-out.bmp");
+    PrintSpectrumPeaks(pool, imageMatrix);
+#else
     WriteMatrixToImage(intermediate, "fwd-byRow.bmp");
     WriteMatrixToImage(imageMatrix, "fwd-out.bmp");
+    PrintSpectrumPeaks(imageMatrix);
+#endif
 
     imageMatrix.Transform([](const std::complex<double>& d) { return std::conj(d); });
     startTime = std::chrono::high_resolution_clock::now();
 #if USE_THREADS
-    imageMatrix = PFFT(imageMatrix, intermediate);
+    imageMatrix = PFFT(pool, imageMatrix, intermediate);
 #else
     imageMatrix = FFT(imageMatrix, intermediate);
 #endif
@@ -164,7 +222,11 @@ int main()
     {
         return std::conj(d) / static_cast<double>(MN);
     });
+#if USE_THREADS
+    WriteMatrixToImage(pool, intermediate, "inv-byRow.bmp", true);
+#else
     WriteMatrixToImage(intermediate, "inv-byRow.bmp", true);
+#endif
 
     RecenterMatrixDataForFFT(imageMatrix);
     imageMatrix.Transform([&](const std::complex<double>& d)
@@ -172,7 +234,11 @@ int main()
         return std::conj(d) / static_cast<double>(MN);
     });
 
+#if USE_THREADS
+    WriteMatrixToImage(pool, imageMatrix, "inv-out.bmp", false);
+#else
     WriteMatrixToImage(imageMatrix, "inv-out.bmp", false);
+#endif
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <future>
+#include <algorithm>
+
+#include "thread_pool.h"
+#include "timer_wheel.h"
+
+#define NUM_TIMERS 1000000
+#define MAX_DELAY_TICKS 600000 // 10 minutes of 1ms ticks
+#define NUM_DEADLINE_JOBS 10000
+
+typedef std::chrono::high_resolution_clock bench_clock;
+
+double NanosecondsPerOp(bench_clock::time_point start, bench_clock::time_point stop, std::size_t numOps)
+{
+    return std::chrono::duration<double, std::nano>(stop - start).count() / numOps;
+}
+
+std::vector<std::uint64_t> GenerateExpiries(std::size_t count)
+{
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<std::uint64_t> dis(1, MAX_DELAY_TICKS);
+    std::vector<std::uint64_t> expiries(count);
+    std::generate(expiries.begin(), expiries.end(), [&] { return dis(gen); });
+    return expiries;
+}
+
+std::vector<std::size_t> GenerateCancelOrder(std::size_t count)
+{
+    // cancel every other timer in random order
+    std::vector<std::size_t> order;
+    order.reserve(count / 2);
+    for (auto i = 0u; i < count; i += 2)
+    {
+        order.push_back(i);
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(7));
+    return order;
+}
+
+void BenchTimerWheel(const std::vector<std::uint64_t>& expiries, const std::vector<std::size_t>& cancelOrder)
+{
+    std::cout << "timer_wheel" << std::endl;
+    timer_wheel wheel;
+    auto fired = 0ull;
+    std::vector<timer_id> ids(expiries.size());
+
+    auto startTime = bench_clock::now();
+    for (auto i = 0u; i < expiries.size(); ++i)
+    {
+        ids[i] = wheel.Schedule(expiries[i], [&fired] { ++fired; });
+    }
+    auto stopTime = bench_clock::now();
+    std::cout << "  Schedule: " << NanosecondsPerOp(startTime, stopTime, expiries.size()) << "ns/timer, "
+        << wheel.Size() << " pending" << std::endl;
+
+    startTime = bench_clock::now();
+    for (auto i : cancelOrder)
+    {
+        wheel.Cancel(ids[i]);
+    }
+    stopTime = bench_clock::now();
+    std::cout << "  Cancel: " << NanosecondsPerOp(startTime, stopTime, cancelOrder.size()) << "ns/timer, "
+        << wheel.Size() << " pending" << std::endl;
+
+    std::vector<function_wrapper> expired;
+    expired.reserve(wheel.Size());
+    const auto numRemaining = wheel.Size();
+    startTime = bench_clock::now();
+    wheel.Advance(MAX_DELAY_TICKS, expired);
+    for (auto& callback : expired)
+    {
+        callback();
+    }
+    stopTime = bench_clock::now();
+    std::cout << "  Expire: " << NanosecondsPerOp(startTime, stopTime, numRemaining) << "ns/timer, "
+        << fired << " fired" << std::endl;
+}
+
+void BenchOrderedMap(const std::vector<std::uint64_t>& expiries, const std::vector<std::size_t>& cancelOrder)
+{
+    // the usual alternative: timers ordered by expiry in a balanced tree
+    std::cout << "std::multimap" << std::endl;
+    typedef std::multimap<std::uint64_t, function_wrapper> timer_map;
+    timer_map timers;
+    auto fired = 0ull;
+    std::vector<timer_map::iterator> ids(expiries.size());
+
+    auto startTime = bench_clock::now();
+    for (auto i = 0u; i < expiries.size(); ++i)
+    {
+        ids[i] = timers.emplace(expiries[i], [&fired] { ++fired; });
+    }
+    auto stopTime = bench_clock::now();
+    std::cout << "  Schedule: " << NanosecondsPerOp(startTime, stopTime, expiries.size()) << "ns/timer, "
+        << timers.size() << " pending" << std::endl;
+
+    startTime = bench_clock::now();
+    for (auto i : cancelOrder)
+    {
+        timers.erase(ids[i]);
+    }
+    stopTime = bench_clock::now();
+    std::cout << "  Cancel: " << NanosecondsPerOp(startTime, stopTime, cancelOrder.size()) << "ns/timer, "
+        << timers.size() << " pending" << std::endl;
+
+    const auto numRemaining = timers.size();
+    startTime = bench_clock::now();
+    while (!timers.empty())
+    {
+        timers.begin()->second();
+        timers.erase(timers.begin());
+    }
+    stopTime = bench_clock::now();
+    std::cout << "  Expire: " << NanosecondsPerOp(startTime, stopTime, numRemaining) << "ns/timer, "
+        << fired << " fired" << std::endl;
+}
+
+void RunDeadlineJobs()
+{
+    // every job gets its own deadline, no thread waits on any of them
+    std::cout << "timer_service with " << NUM_DEADLINE_JOBS << " deadline-attached jobs" << std::endl;
+    thread_pool pool;
+    timer_service timers(pool);
+
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<> workMs(0, 20);
+    std::uniform_int_distribution<> deadlineMs(5, 50);
+
+    auto startTime = bench_clock::now();
+    std::vector<std::future<int>> results;
+    results.reserve(NUM_DEADLINE_JOBS);
+    for (auto i = 0; i < NUM_DEADLINE_JOBS; ++i)
+    {
+        const auto work = std::chrono::milliseconds(workMs(gen));
+        const auto deadline = timer_service::clock::now() + std::chrono::milliseconds(deadlineMs(gen));
+        results.push_back(timers.SubmitWithDeadline([work, i]
+        {
+            std::this_thread::sleep_for(work);
+            return i;
+        }, deadline));
+    }
+
+    auto completed = 0;
+    auto timedOut = 0;
+    for (auto& result : results)
+    {
+        try
+        {
+            result.get();
+            ++completed;
+        }
+        catch (const deadline_exceeded&)
+        {
+            ++timedOut;
+        }
+    }
+    auto stopTime = bench_clock::now();
+
+    std::cout << "  Completed: " << completed << std::endl
+        << "  Timed out: " << timedOut << std::endl
+        << "  Duration: " << std::chrono::duration<float, std::milli>(stopTime - startTime).count() << "ms" << std::endl;
+}
+
+int main()
+{
+    std::cout << "Num Timers: " << NUM_TIMERS << std::endl;
+    const auto expiries = GenerateExpiries(NUM_TIMERS);
+    const auto cancelOrder = GenerateCancelOrder(NUM_TIMERS);
+
+    BenchTimerWheel(expiries, cancelOrder);
+    BenchOrderedMap(expiries, cancelOrder);
+    RunDeadlineJobs();
+
+    return 0;
+}
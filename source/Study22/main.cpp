@@ -0,0 +1,231 @@
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "spsc_channel.h"
+
+#define NUM_MESSAGES 10000000
+#define NUM_ROUND_TRIPS 100000
+#define CHANNEL_CAPACITY 4096
+#define BATCH_SIZE 256
+
+typedef std::chrono::high_resolution_clock bench_clock;
+
+/*
+The Study06 handoff: a mutex and a condition_variable guarding the shared data,
+here around a queue so more than one item can be in flight
+*/
+template <typename T>
+class locked_queue
+{
+private:
+    std::queue<T> _items;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    bool _closed = false;
+
+public:
+    void Push(T value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _items.push(std::move(value));
+        }
+        _cond.notify_one();
+    }
+
+    bool Pop(T& value)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this] { return _closed || !_items.empty(); });
+        if (_items.empty())
+        {
+            return false;
+        }
+        value = std::move(_items.front());
+        _items.pop();
+        return true;
+    }
+
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+        }
+        _cond.notify_all();
+    }
+};
+
+void PrintThroughput(const char* name, bench_clock::time_point start, bench_clock::time_point stop, long long sum)
+{
+    const auto seconds = std::chrono::duration<double>(stop - start).count();
+    std::cout << name << ": " << NUM_MESSAGES / seconds / 1e6 << "M msg/s, "
+        << seconds * 1e9 / NUM_MESSAGES << "ns/msg (checksum " << sum << ")" << std::endl;
+}
+
+void PrintLatency(const char* name, bench_clock::time_point start, bench_clock::time_point stop)
+{
+    std::cout << name << ": " << std::chrono::duration<double, std::nano>(stop - start).count() / NUM_ROUND_TRIPS
+        << "ns/round trip" << std::endl;
+}
+
+void ThroughputLockedQueue()
+{
+    locked_queue<int> queue;
+    auto sum = 0ll;
+
+    auto startTime = bench_clock::now();
+    std::thread consumer([&]
+    {
+        int value;
+        while (queue.Pop(value))
+        {
+            sum += value;
+        }
+    });
+    for (auto i = 0; i < NUM_MESSAGES; ++i)
+    {
+        queue.Push(i);
+    }
+    queue.Close();
+    consumer.join();
+    auto stopTime = bench_clock::now();
+
+    PrintThroughput("mutex + condition_variable", startTime, stopTime, sum);
+}
+
+void ThroughputChannel()
+{
+    spsc_channel<int> channel(CHANNEL_CAPACITY);
+    auto sum = 0ll;
+
+    auto startTime = bench_clock::now();
+    std::thread consumer([&]
+    {
+        int value;
+        while (channel.Pop(value))
+        {
+            sum += value;
+        }
+    });
+    for (auto i = 0; i < NUM_MESSAGES; ++i)
+    {
+        channel.Push(i);
+    }
+    channel.Close();
+    consumer.join();
+    auto stopTime = bench_clock::now();
+
+    PrintThroughput("spsc_channel", startTime, stopTime, sum);
+}
+
+void ThroughputChannelBatched()
+{
+    spsc_channel<int> channel(CHANNEL_CAPACITY);
+    auto sum = 0ll;
+
+    auto startTime = bench_clock::now();
+    std::thread consumer([&]
+    {
+        std::vector<int> batch(BATCH_SIZE);
+        while (auto count = channel.PopBatch(batch.begin(), batch.size()))
+        {
+            for (auto i = 0u; i < count; ++i)
+            {
+                sum += batch[i];
+            }
+        }
+    });
+
+    std::vector<int> batch(BATCH_SIZE);
+    for (auto i = 0; i < NUM_MESSAGES; i += BATCH_SIZE)
+    {
+        const auto count = std::min(BATCH_SIZE, NUM_MESSAGES - i);
+        for (auto j = 0; j < count; ++j)
+        {
+            batch[j] = i + j;
+        }
+        channel.PushBatch(batch.begin(), batch.begin() + count);
+    }
+    channel.Close();
+    consumer.join();
+    auto stopTime = bench_clock::now();
+
+    PrintThroughput("spsc_channel batched", startTime, stopTime, sum);
+}
+
+void LatencyLockedQueue()
+{
+    locked_queue<int> ping;
+    locked_queue<int> pong;
+
+    std::thread echo([&]
+    {
+        int value;
+        while (ping.Pop(value))
+        {
+            pong.Push(value);
+        }
+    });
+
+    auto startTime = bench_clock::now();
+    for (auto i = 0; i < NUM_ROUND_TRIPS; ++i)
+    {
+        int value;
+        ping.Push(i);
+        pong.Pop(value);
+    }
+    auto stopTime = bench_clock::now();
+    ping.Close();
+    echo.join();
+
+    PrintLatency("mutex + condition_variable", startTime, stopTime);
+}
+
+void LatencyChannel()
+{
+    spsc_channel<int> ping(CHANNEL_CAPACITY);
+    spsc_channel<int> pong(CHANNEL_CAPACITY);
+
+    std::thread echo([&]
+    {
+        int value;
+        while (ping.Pop(value))
+        {
+            pong.Push(value);
+        }
+    });
+
+    auto startTime = bench_clock::now();
+    for (auto i = 0; i < NUM_ROUND_TRIPS; ++i)
+    {
+        int value;
+        ping.Push(i);
+        pong.Pop(value);
+    }
+    auto stopTime = bench_clock::now();
+    ping.Close();
+    echo.join();
+
+    PrintLatency("spsc_channel", startTime, stopTime);
+}
+
+int main()
+{
+    std::cout << "Throughput, " << NUM_MESSAGES << " messages" << std::endl;
+    ThroughputLockedQueue();
+    ThroughputChannel();
+    ThroughputChannelBatched();
+
+    std::cout << "Latency, " << NUM_ROUND_TRIPS << " round trips" << std::endl;
+    LatencyLockedQueue();
+    LatencyChannel();
+
+    return 0;
+}
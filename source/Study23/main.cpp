@@ -0,0 +1,166 @@
+#include <iostream>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <numeric>
+
+#include "matrix.h"
+#include "sharded_counter.h"
+#include "thread_pool.h"
+
+#define NUM_THREADS 64
+#define NUM_INCREMENTS_PER_THREAD 1000000ull
+#define NUM_BINS 16
+#define MATRIX_SIZE 4096
+
+typedef std::chrono::high_resolution_clock bench_clock;
+
+/*
+Runs body(threadIndex) on NUM_THREADS threads released at the same time,
+returns the wall time from the release to the last thread finishing
+*/
+template <typename Body>
+float RaceThreads(const Body& body)
+{
+    std::promise<void> go;
+    auto start = go.get_future().share();
+
+    std::vector<std::thread> threads;
+    threads.reserve(NUM_THREADS);
+    for (auto i = 0u; i < NUM_THREADS; ++i)
+    {
+        threads.emplace_back([&body, start, i]
+        {
+            start.wait();
+            body(i);
+        });
+    }
+
+    auto startTime = bench_clock::now();
+    go.set_value();
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    auto stopTime = bench_clock::now();
+    return std::chrono::duration<float, std::milli>(stopTime - startTime).count();
+}
+
+void PrintResult(const char* name, float durationMS, unsigned long long value)
+{
+    const auto expected = NUM_THREADS * NUM_INCREMENTS_PER_THREAD;
+    std::cout << name << ": " << durationMS << "ms, "
+        << durationMS * 1e6f / expected << "ns/increment, "
+        << value << ((value == expected) ? "" : " (wrong)") << std::endl;
+}
+
+void BenchCounters()
+{
+    std::cout << NUM_THREADS << " threads x " << NUM_INCREMENTS_PER_THREAD << " increments" << std::endl;
+
+    {
+        // Study12's race
+        auto a = 0ull;
+        const auto duration = RaceThreads([&](unsigned int)
+        {
+            for (auto i = 0ull; i < NUM_INCREMENTS_PER_THREAD; ++i)
+            {
+                ++reinterpret_cast<volatile unsigned long long&>(a);
+            }
+        });
+        PrintResult("unsynchronized", duration, a);
+    }
+
+    {
+        auto a = 0ull;
+        std::mutex m;
+        const auto duration = RaceThreads([&](unsigned int)
+        {
+            for (auto i = 0ull; i < NUM_INCREMENTS_PER_THREAD; ++i)
+            {
+                std::lock_guard<std::mutex> lock(m);
+                ++a;
+            }
+        });
+        PrintResult("std::mutex", duration, a);
+    }
+
+    {
+        std::atomic<unsigned long long> a(0);
+        const auto duration = RaceThreads([&](unsigned int)
+        {
+            for (auto i = 0ull; i < NUM_INCREMENTS_PER_THREAD; ++i)
+            {
+                a.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        PrintResult("std::atomic", duration, a.load());
+    }
+
+    {
+        sharded_counter<unsigned long long> a;
+        const auto duration = RaceThreads([&](unsigned int)
+        {
+            for (auto i = 0ull; i < NUM_INCREMENTS_PER_THREAD; ++i)
+            {
+                a.Increment();
+            }
+        });
+        PrintResult("sharded_counter", duration, a.Value());
+    }
+}
+
+void BenchHistogram()
+{
+    sharded_histogram histogram(NUM_BINS);
+    const auto duration = RaceThreads([&](unsigned int threadIndex)
+    {
+        std::mt19937 gen(threadIndex);
+        std::uniform_int_distribution<std::size_t> dis(0, NUM_BINS - 1);
+        for (auto i = 0ull; i < NUM_INCREMENTS_PER_THREAD; ++i)
+        {
+            histogram.Add(dis(gen));
+        }
+    });
+
+    const auto counts = histogram.Counts();
+    std::cout << "sharded_histogram: " << duration << "ms, "
+        << std::accumulate(counts.begin(), counts.end(), 0ull) << " samples in " << NUM_BINS << " bins" << std::endl;
+}
+
+void BenchNormalize()
+{
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<double> dis(-100.0, 100.0);
+    std::vector<double> data(MATRIX_SIZE * MATRIX_SIZE);
+    for (auto& d : data)
+    {
+        d = dis(gen);
+    }
+    matrix<double> serial(MATRIX_SIZE, MATRIX_SIZE, data);
+    matrix<double> parallel(MATRIX_SIZE, MATRIX_SIZE, std::move(data));
+
+    auto startTime = bench_clock::now();
+    serial.Normalize();
+    auto stopTime = bench_clock::now();
+    std::cout << "matrix::Normalize(): " << std::chrono::duration<float, std::milli>(stopTime - startTime).count() << "ms" << std::endl;
+
+    startTime = bench_clock::now();
+    parallel.Normalize(thread_pool::Default());
+    stopTime = bench_clock::now();
+    std::cout << "matrix::Normalize(thread_pool&): " << std::chrono::duration<float, std::milli>(stopTime - startTime).count() << "ms, "
+        << (serial.Raw() == parallel.Raw() ? "same" : "different") << " result" << std::endl;
+}
+
+int main()
+{
+    BenchCounters();
+    BenchHistogram();
+    BenchNormalize();
+
+    return 0;
+}
@@ -0,0 +1,260 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+
+#include "argsort.h"
+#include "matrix.h"
+#include "parallel_sort.h"
+#include "radix_sort.h"
+#include "sample_sort.h"
+#include "thread_pool.h"
+
+#define NUM_ELEMENTS 100000000
+#define NUM_RECORDS 10000000
+#define MATRIX_SIZE 4096
+
+/*
+Key with a payload, sorted with a user comparator
+*/
+struct record
+{
+    std::uint64_t key;
+    std::uint64_t payload;
+};
+
+std::vector<int> GenerateInts(std::size_t count)
+{
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<> dis;
+    std::vector<int> data(count);
+    std::generate(data.begin(), data.end(), [&] { return dis(gen); });
+    return data;
+}
+
+std::vector<record> GenerateRecords(std::size_t count)
+{
+    std::mt19937_64 gen(2);
+    std::vector<record> data(count);
+    for (auto i = 0u; i < count; ++i)
+    {
+        data[i] = { gen(), i };
+    }
+    return data;
+}
+
+template <typename T, typename Compare, typename Sort>
+float TimeSort(const std::vector<T>& source, Compare comp, const Sort& sort)
+{
+    auto data = source;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    sort(data);
+    auto stopTime = std::chrono::high_resolution_clock::now();
+
+    if (!std::is_sorted(data.begin(), data.end(), comp))
+    {
+        std::cout << "not sorted" << std::endl;
+    }
+    return std::chrono::duration<float, std::milli>(stopTime - startTime).count();
+}
+
+/*
+std::sort once, then parallel_sample_sort with 2, 4, 8 ... threads
+(the calling thread counts as one)
+*/
+template <typename T, typename Compare>
+void BenchSpeedup(const std::vector<T>& source, Compare comp)
+{
+    const auto serial = TimeSort(source, comp, [&](std::vector<T>& data)
+    {
+        std::sort(data.begin(), data.end(), comp);
+    });
+    std::cout << "  std::sort: " << serial << "ms" << std::endl;
+
+    const auto maxThreads = std::max(GetHardwareThreadCount(), 2u);
+    for (auto numThreads = 2u; ; numThreads = std::min(numThreads * 2, maxThreads))
+    {
+        thread_pool pool(numThreads - 1);
+        const auto parallel = TimeSort(source, comp, [&](std::vector<T>& data)
+        {
+            parallel_sample_sort(pool, data.begin(), data.end(), comp);
+        });
+        std::cout << "  parallel_sample_sort, " << numThreads << " threads: " << parallel << "ms, "
+            << serial / parallel << "x" << std::endl;
+
+        if (numThreads == maxThreads)
+        {
+            break;
+        }
+    }
+}
+
+/*
+For integer and float keys a radix sort needs no comparisons at all
+*/
+template <typename T, typename Compare, typename KeyOf>
+void BenchRadix(const std::vector<T>& source, Compare comp, KeyOf keyOf)
+{
+    auto& pool = thread_pool::Default();
+    const auto sample = TimeSort(source, comp, [&](std::vector<T>& data)
+    {
+        parallel_sample_sort(pool, data.begin(), data.end(), comp);
+    });
+    const auto radix = TimeSort(source, comp, [&](std::vector<T>& data)
+    {
+        parallel_radix_sort(pool, data.begin(), data.end(), keyOf);
+    });
+    std::cout << "  parallel_sample_sort: " << sample << "ms" << std::endl
+        << "  parallel_radix_sort: " << radix << "ms, " << sample / radix << "x" << std::endl;
+}
+
+/*
+-0.0 and +0.0 compare equal, so is_sorted cannot tell when a sort wrote one of
+them twice: the number of negative zeros has to be the same afterwards
+*/
+void CheckSignedZeros(std::mt19937& gen)
+{
+    auto& pool = thread_pool::Default();
+    std::uniform_int_distribution<> dis(-1000, 1000);
+    std::vector<float> source(NUM_RECORDS);
+    std::generate(source.begin(), source.end(), [&]
+    {
+        // few enough zeros of either sign that they end up in small sorts next to other keys
+        const auto v = dis(gen);
+        return (v < -990) ? -0.0f : (v < -980) ? 0.0f : static_cast<float>(v);
+    });
+
+    auto countNegativeZeros = [](const std::vector<float>& data)
+    {
+        return std::count_if(data.begin(), data.end(), [](float v) { return v == 0.0f && std::signbit(v); });
+    };
+    const auto expected = countNegativeZeros(source);
+    auto check = [&](const char* name, const std::function<void(std::vector<float>&)>& sort)
+    {
+        auto data = source;
+        sort(data);
+        const auto kept = std::is_sorted(data.begin(), data.end()) && countNegativeZeros(data) == expected;
+        std::cout << "  " << name << ": " << (kept ? "all zeros kept" : "zeros lost") << std::endl;
+    };
+
+    check("parallel_sample_sort", [&](std::vector<float>& data) { parallel_sample_sort(pool, data.begin(), data.end(), std::less<float>()); });
+    check("parallel_stable_sort", [&](std::vector<float>& data) { parallel_stable_sort(pool, data.begin(), data.end(), std::less<float>()); });
+    check("parallel_radix_sort", [&](std::vector<float>& data) { parallel_radix_sort(pool, data.begin(), data.end(), [](float v) { return v; }); });
+}
+
+/*
+Records sorted in place by a projection, no copying of keys into a separate vector
+parallel_stable_sort keeps the generation order (payload) of equal keys
+*/
+void BenchProjection(const std::vector<record>& source)
+{
+    auto& pool = thread_pool::Default();
+    auto byKey = [](const record& r) { return r.key % 1000; };
+    auto comp = [&](const record& a, const record& b) { return byKey(a) < byKey(b); };
+
+    const auto stable = TimeSort(source, comp, [&](std::vector<record>& data)
+    {
+        std::stable_sort(data.begin(), data.end(), comp);
+    });
+    const auto parallel = TimeSort(source, comp, [&](std::vector<record>& data)
+    {
+        parallel_sort(pool, data.begin(), data.end(), std::less<>(), byKey);
+    });
+
+    // equal keys must still be in payload order
+    auto stableComp = [&](const record& a, const record& b)
+    {
+        return byKey(a) < byKey(b) || (byKey(a) == byKey(b) && a.payload < b.payload);
+    };
+    const auto parallelStable = TimeSort(source, stableComp, [&](std::vector<record>& data)
+    {
+        parallel_stable_sort(pool, data.begin(), data.end(), std::less<>(), byKey);
+    });
+    std::cout << "  std::stable_sort: " << stable << "ms" << std::endl
+        << "  parallel_sort: " << parallel << "ms" << std::endl
+        << "  parallel_stable_sort: " << parallelStable << "ms, " << stable / parallelStable << "x" << std::endl;
+}
+
+/*
+Argsort of a matrix: the indices of its elements in value order, the matrix
+itself is not touched; apply_permutation then gathers the sorted values
+*/
+void BenchArgsort(const matrix<double>& m)
+{
+    auto& pool = thread_pool::Default();
+    const auto& values = m.Raw();
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    std::vector<std::size_t> serial(values.size());
+    std::iota(serial.begin(), serial.end(), std::size_t(0));
+    std::stable_sort(serial.begin(), serial.end(), [&](std::size_t a, std::size_t b) { return values[a] < values[b]; });
+    auto stopTime = std::chrono::high_resolution_clock::now();
+    const auto stable = std::chrono::duration<float, std::milli>(stopTime - startTime).count();
+
+    startTime = std::chrono::high_resolution_clock::now();
+    const auto permutation = parallel_argsort(pool, values.begin(), values.end());
+    stopTime = std::chrono::high_resolution_clock::now();
+    const auto parallel = std::chrono::duration<float, std::milli>(stopTime - startTime).count();
+
+    startTime = std::chrono::high_resolution_clock::now();
+    std::vector<double> sorted(values.size());
+    apply_permutation(pool, values.begin(), permutation, sorted.begin());
+    stopTime = std::chrono::high_resolution_clock::now();
+    const auto gather = std::chrono::duration<float, std::milli>(stopTime - startTime).count();
+
+    if (permutation != serial || !std::is_sorted(sorted.begin(), sorted.end()))
+    {
+        std::cout << "wrong permutation" << std::endl;
+    }
+    std::cout << "  std::stable_sort of indices: " << stable << "ms" << std::endl
+        << "  parallel_argsort: " << parallel << "ms, " << stable / parallel << "x" << std::endl
+        << "  apply_permutation: " << gather << "ms" << std::endl;
+}
+
+int main()
+{
+    std::cout << NUM_ELEMENTS << " random ints" << std::endl;
+    BenchSpeedup(GenerateInts(NUM_ELEMENTS), std::less<int>());
+
+    std::cout << NUM_RECORDS << " records by key" << std::endl;
+    BenchSpeedup(GenerateRecords(NUM_RECORDS), [](const record& a, const record& b)
+    {
+        return a.key < b.key;
+    });
+
+    std::cout << "Radix sort, " << thread_pool::Default().Size() + 1 << " threads" << std::endl;
+    std::cout << NUM_ELEMENTS << " random ints" << std::endl;
+    BenchRadix(GenerateInts(NUM_ELEMENTS), std::less<int>(), [](int v) { return v; });
+
+    std::cout << NUM_RECORDS << " records by key" << std::endl;
+    BenchRadix(GenerateRecords(NUM_RECORDS), [](const record& a, const record& b)
+    {
+        return a.key < b.key;
+    }, [](const record& r) { return r.key; });
+
+    std::cout << NUM_RECORDS << " random floats" << std::endl;
+    std::vector<float> floats(NUM_RECORDS);
+    std::mt19937 gen(3);
+    std::normal_distribution<float> dis(0.0f, 1000.0f);
+    std::generate(floats.begin(), floats.end(), [&] { return dis(gen); });
+    BenchRadix(floats, std::less<float>(), [](float v) { return v; });
+
+    std::cout << NUM_RECORDS << " floats, 1% of them -0.0 or +0.0" << std::endl;
+    CheckSignedZeros(gen);
+
+    std::cout << NUM_RECORDS << " records by key % 1000, projected" << std::endl;
+    BenchProjection(GenerateRecords(NUM_RECORDS));
+
+    std::cout << MATRIX_SIZE << "x" << MATRIX_SIZE << " matrix<double>, argsort" << std::endl;
+    matrix<double> m(MATRIX_SIZE, MATRIX_SIZE);
+    std::uniform_int_distribution<> values(0, 1 << 20);
+    std::generate(m.Raw().begin(), m.Raw().end(), [&] { return values(gen) / 16.0; });
+    BenchArgsort(m);
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdint>
+
+#include "external_sort.h"
+#include "thread_pool.h"
+
+#define NUM_RECORDS 200000000 // 3.2GB of 16 byte records
+#define MEMORY_BUDGET_MB 256
+#define INPUT_FILE "unsorted.bin"
+#define OUTPUT_FILE "sorted.bin"
+#define TEMP_DIRECTORY "."
+
+/*
+Key with a payload, sorted by key
+*/
+struct record
+{
+    std::uint64_t key;
+    std::uint64_t payload;
+};
+
+void GenerateInput(const std::string& path, std::size_t count)
+{
+    std::cout << "Writing " << count << " random records to " << path << std::endl;
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    std::mt19937_64 gen(1);
+    std::vector<record> block(1 << 20);
+    for (auto written = std::size_t(0); written < count; )
+    {
+        const auto blockSize = std::min(block.size(), count - written);
+        for (auto i = 0u; i < blockSize; ++i)
+        {
+            block[i] = { gen(), written + i };
+        }
+        file.write(reinterpret_cast<const char*>(block.data()), blockSize * sizeof(record));
+        written += blockSize;
+    }
+}
+
+/*
+Streams through the output once, checking order and count
+*/
+bool IsSortedFile(const std::string& path, std::size_t expectedCount)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::vector<record> block(1 << 20);
+    auto count = std::size_t(0);
+    auto previous = std::uint64_t(0);
+    while (file)
+    {
+        file.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(record));
+        const auto blockSize = static_cast<std::size_t>(file.gcount()) / sizeof(record);
+        for (auto i = 0u; i < blockSize; ++i)
+        {
+            if (block[i].key < previous)
+            {
+                return false;
+            }
+            previous = block[i].key;
+        }
+        count += blockSize;
+    }
+    return count == expectedCount;
+}
+
+int main()
+{
+    GenerateInput(INPUT_FILE, NUM_RECORDS);
+
+    external_sort_options options;
+    options.memoryBudget = std::size_t(MEMORY_BUDGET_MB) << 20;
+    options.tempDirectory = TEMP_DIRECTORY;
+
+    std::cout << "Sorting with " << MEMORY_BUDGET_MB << "MB of memory, " << thread_pool::Default().Size() + 1
+        << " threads" << std::endl;
+    auto startTime = std::chrono::high_resolution_clock::now();
+    const auto stats = external_sort<record>(INPUT_FILE, OUTPUT_FILE, [](const record& a, const record& b)
+    {
+        return a.key < b.key;
+    }, options);
+    auto stopTime = std::chrono::high_resolution_clock::now();
+
+    const auto seconds = std::chrono::duration<float>(stopTime - startTime).count();
+    const auto megabytes = stats.numRecords * sizeof(record) / float(1 << 20);
+    std::cout << stats.numRuns << " runs, " << stats.numMergePasses << " merge passes" << std::endl;
+    std::cout << "Sort time: " << seconds << "s, " << megabytes / seconds << "MB/s" << std::endl;
+
+    std::cout << (IsSortedFile(OUTPUT_FILE, NUM_RECORDS) ? "sorted" : "not sorted") << std::endl;
+
+    return 0;
+}
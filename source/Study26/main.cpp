@@ -0,0 +1,249 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+#define MIN_ELEMENTS 1000
+#define MAX_ELEMENTS 100000000 // 1000000000 works too but needs about 12GB (input, working copy and scratch buffer)
+#define NUM_REPEATS 5
+#define USE_STD_PARALLEL 1
+#define CSV_FILE "sort_benchmark.csv"
+
+#if USE_STD_PARALLEL
+#include <execution>
+#endif
+
+#include "parallel_sort.h"
+#include "quicksort.h"
+#include "radix_sort.h"
+#include "sample_sort.h"
+#include "thread_pool.h"
+
+/*
+Input distributions
+*/
+struct input_distribution
+{
+    const char* name;
+    std::function<std::vector<int>(std::size_t, std::mt19937&)> generate;
+};
+
+std::vector<int> GenerateRandom(std::size_t count, std::mt19937& gen)
+{
+    std::uniform_int_distribution<> dis;
+    std::vector<int> data(count);
+    std::generate(data.begin(), data.end(), [&] { return dis(gen); });
+    return data;
+}
+
+std::vector<int> GenerateSorted(std::size_t count, std::mt19937&)
+{
+    std::vector<int> data(count);
+    for (auto i = 0u; i < count; ++i)
+    {
+        data[i] = static_cast<int>(i);
+    }
+    return data;
+}
+
+std::vector<int> GenerateReverse(std::size_t count, std::mt19937& gen)
+{
+    auto data = GenerateSorted(count, gen);
+    std::reverse(data.begin(), data.end());
+    return data;
+}
+
+// ascending to the middle, then descending
+std::vector<int> GenerateOrganPipe(std::size_t count, std::mt19937&)
+{
+    std::vector<int> data(count);
+    for (auto i = 0u; i < count; ++i)
+    {
+        data[i] = static_cast<int>(std::min<std::size_t>(i, count - 1 - i));
+    }
+    return data;
+}
+
+std::vector<int> GenerateFewUnique(std::size_t count, std::mt19937& gen)
+{
+    std::uniform_int_distribution<> dis(0, 15);
+    std::vector<int> data(count);
+    std::generate(data.begin(), data.end(), [&] { return dis(gen); });
+    return data;
+}
+
+// P(k) proportional to 1/k over 100000 keys, a handful of keys make up most of the input
+std::vector<int> GenerateZipf(std::size_t count, std::mt19937& gen)
+{
+    std::vector<double> weights(100000);
+    for (auto k = 0u; k < weights.size(); ++k)
+    {
+        weights[k] = 1.0 / (k + 1);
+    }
+    std::discrete_distribution<int> dis(weights.begin(), weights.end());
+    std::vector<int> data(count);
+    std::generate(data.begin(), data.end(), [&] { return dis(gen); });
+    return data;
+}
+
+// sorted with 1% of the elements swapped to random places
+std::vector<int> GenerateNearlySorted(std::size_t count, std::mt19937& gen)
+{
+    auto data = GenerateSorted(count, gen);
+    std::uniform_int_distribution<std::size_t> dis(0, count - 1);
+    for (auto i = 0u; i < count / 100; ++i)
+    {
+        std::swap(data[dis(gen)], data[dis(gen)]);
+    }
+    return data;
+}
+
+/*
+Sort engines; serial ones only run with 1 thread, std::execution::par picks
+its own threads and only runs with all of them
+*/
+enum class thread_mode
+{
+    serial,
+    pool,
+    all_threads
+};
+
+struct sort_engine
+{
+    const char* name;
+    thread_mode threads;
+    std::function<void(thread_pool&, std::vector<int>&)> sort;
+};
+
+struct run_times
+{
+    float median;
+    float p95;
+};
+
+run_times TimeSort(const sort_engine& engine, thread_pool& pool, const std::vector<int>& source, unsigned int numRepeats)
+{
+    std::vector<float> times;
+    for (auto repeat = 0u; repeat < numRepeats; ++repeat)
+    {
+        auto data = source;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        engine.sort(pool, data);
+        auto stopTime = std::chrono::high_resolution_clock::now();
+        times.push_back(std::chrono::duration<float, std::milli>(stopTime - startTime).count());
+
+        if (!std::is_sorted(data.begin(), data.end()))
+        {
+            std::cout << engine.name << ": not sorted" << std::endl;
+        }
+    }
+
+    std::sort(times.begin(), times.end());
+    const auto p95Index = std::min<std::size_t>(times.size() - 1, (times.size() * 95 + 99) / 100 - 1);
+    return { times[times.size() / 2], times[p95Index] };
+}
+
+int main()
+{
+    const std::vector<input_distribution> distributions =
+    {
+        { "random", GenerateRandom },
+        { "sorted", GenerateSorted },
+        { "reverse", GenerateReverse },
+        { "organ_pipe", GenerateOrganPipe },
+        { "few_unique", GenerateFewUnique },
+        { "zipf", GenerateZipf },
+        { "nearly_sorted", GenerateNearlySorted },
+    };
+
+    const std::vector<sort_engine> engines =
+    {
+        { "std::sort", thread_mode::serial, [](thread_pool&, std::vector<int>& data) { std::sort(data.begin(), data.end()); } },
+#if USE_STD_PARALLEL
+        { "std::sort(par)", thread_mode::all_threads, [](thread_pool&, std::vector<int>& data)
+        {
+            std::sort(std::execution::par, data.begin(), data.end());
+        } },
+#endif
+        { "IntroSort", thread_mode::serial, [](thread_pool&, std::vector<int>& data) { IntroSort(data.begin(), data.end()); } },
+        { "parallel_sort", thread_mode::pool, [](thread_pool& pool, std::vector<int>& data)
+        {
+            parallel_sort(pool, data.begin(), data.end());
+        } },
+        { "parallel_stable_sort", thread_mode::pool, [](thread_pool& pool, std::vector<int>& data)
+        {
+            parallel_stable_sort(pool, data.begin(), data.end());
+        } },
+        { "parallel_sample_sort", thread_mode::pool, [](thread_pool& pool, std::vector<int>& data)
+        {
+            parallel_sample_sort(pool, data.begin(), data.end());
+        } },
+        { "parallel_radix_sort", thread_mode::pool, [](thread_pool& pool, std::vector<int>& data)
+        {
+            parallel_radix_sort(pool, data.begin(), data.end());
+        } },
+    };
+
+    // 1, 2, 4 ... threads and all of them, the calling thread counts as one
+    const auto maxThreads = GetHardwareThreadCount();
+    std::vector<unsigned int> threadCounts;
+    for (auto numThreads = 1u; numThreads < maxThreads; numThreads *= 2)
+    {
+        threadCounts.push_back(numThreads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    std::vector<std::unique_ptr<thread_pool>> pools;
+    for (auto numThreads : threadCounts)
+    {
+        pools.emplace_back(new thread_pool(numThreads - 1));
+    }
+
+    std::ofstream csv(CSV_FILE);
+    csv << "engine,distribution,elements,threads,median_ms,p95_ms,speedup" << std::endl;
+
+    std::mt19937 gen(1);
+    for (auto numElements = std::size_t(MIN_ELEMENTS); numElements <= std::size_t(MAX_ELEMENTS); numElements *= 10)
+    {
+        for (const auto& distribution : distributions)
+        {
+            const auto source = distribution.generate(numElements, gen);
+            std::cout << numElements << " " << distribution.name << std::endl;
+
+            // std::sort with one thread is what every speedup is measured against
+            auto baseline = 0.0f;
+            for (const auto& engine : engines)
+            {
+                for (auto i = 0u; i < threadCounts.size(); ++i)
+                {
+                    const auto numThreads = threadCounts[i];
+                    if ((engine.threads == thread_mode::serial && numThreads != 1) ||
+                        (engine.threads == thread_mode::all_threads && numThreads != maxThreads))
+                    {
+                        continue;
+                    }
+
+                    const auto times = TimeSort(engine, *pools[i], source, NUM_REPEATS);
+                    if (baseline == 0.0f)
+                    {
+                        baseline = times.median;
+                    }
+                    const auto speedup = baseline / times.median;
+
+                    csv << engine.name << "," << distribution.name << "," << numElements << "," << numThreads << ","
+                        << times.median << "," << times.p95 << "," << speedup << std::endl;
+                    std::cout << "  " << engine.name << ", " << numThreads << " threads: " << times.median << "ms median, "
+                        << times.p95 << "ms p95, " << speedup << "x" << std::endl;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+
+#define NUM_ELEMENTS 100000000
+#define NUM_REPEATS 5
+#define USE_STD_PARALLEL 1
+
+#if USE_STD_PARALLEL
+#include <execution>
+#endif
+
+#include "parallel_for.h"
+#include "parallel_scan.h"
+#include "thread_pool.h"
+
+/*
+Best of NUM_REPEATS runs, in milliseconds
+*/
+template <typename Body>
+float TimeBest(const Body& body)
+{
+    auto best = 0.0f;
+    for (auto repeat = 0; repeat < NUM_REPEATS; ++repeat)
+    {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        body();
+        auto stopTime = std::chrono::high_resolution_clock::now();
+        const auto time = std::chrono::duration<float, std::milli>(stopTime - startTime).count();
+        best = (repeat == 0) ? time : std::min(best, time);
+    }
+    return best;
+}
+
+/*
+Inclusive scan: std::inclusive_scan serial and with std::execution::par,
+then parallel_inclusive_scan with 1, 2, 4 ... threads (the calling thread
+counts as one). Results are compared with the serial scan.
+*/
+template <typename T>
+void BenchInclusiveScan(const std::vector<T>& source)
+{
+    std::vector<T> expected(source.size());
+    std::vector<T> result(source.size());
+
+    const auto serial = TimeBest([&] { std::inclusive_scan(source.begin(), source.end(), expected.begin()); });
+    std::cout << "  std::inclusive_scan: " << serial << "ms" << std::endl;
+
+#if USE_STD_PARALLEL
+    const auto par = TimeBest([&]
+    {
+        std::inclusive_scan(std::execution::par, source.begin(), source.end(), result.begin());
+    });
+    std::cout << "  std::inclusive_scan(par): " << par << "ms, " << serial / par << "x" << std::endl;
+#endif
+
+    const auto maxThreads = GetHardwareThreadCount();
+    for (auto numThreads = 1u; ; numThreads = std::min(numThreads * 2, maxThreads))
+    {
+        thread_pool pool(numThreads - 1);
+        const auto parallel = TimeBest([&] { parallel_inclusive_scan(pool, source.begin(), source.end(), result.begin()); });
+
+        const auto matches = (result == expected);
+        std::cout << "  parallel_inclusive_scan, " << numThreads << " threads: " << parallel << "ms, " << serial / parallel << "x"
+            << (matches ? "" : ", wrong result") << std::endl;
+
+        if (numThreads == maxThreads)
+        {
+            break;
+        }
+    }
+}
+
+/*
+Stream compaction: the exclusive scan of keep flags gives every kept element
+its output position, so all threads write the output without coordination
+*/
+void BenchCompaction(const std::vector<int>& source)
+{
+    auto& pool = thread_pool::Default();
+    auto keep = [](int v) { return v % 3 == 0; };
+
+    std::vector<int> expected;
+    expected.reserve(source.size());
+    const auto serial = TimeBest([&]
+    {
+        expected.clear();
+        std::copy_if(source.begin(), source.end(), std::back_inserter(expected), keep);
+    });
+
+    std::vector<int> positions(source.size());
+    std::vector<int> compacted(source.size());
+    auto numKept = std::size_t(0);
+    const auto parallel = TimeBest([&]
+    {
+        parallel_for(pool, std::size_t(0), source.size(), [&](std::size_t chunkFirst, std::size_t chunkLast)
+        {
+            for (auto i = chunkFirst; i < chunkLast; ++i)
+            {
+                positions[i] = keep(source[i]) ? 1 : 0;
+            }
+        });
+        parallel_exclusive_scan(pool, positions.begin(), positions.end(), positions.begin(), 0);
+        numKept = static_cast<std::size_t>(positions.back()) + (keep(source.back()) ? 1 : 0);
+
+        parallel_for(pool, std::size_t(0), source.size(), [&](std::size_t chunkFirst, std::size_t chunkLast)
+        {
+            for (auto i = chunkFirst; i < chunkLast; ++i)
+            {
+                if (keep(source[i]))
+                {
+                    compacted[positions[i]] = source[i];
+                }
+            }
+        });
+    });
+
+    const auto matches = numKept == expected.size() && std::equal(expected.begin(), expected.end(), compacted.begin());
+    std::cout << "  std::copy_if: " << serial << "ms" << std::endl
+        << "  flags, parallel_exclusive_scan, scatter: " << parallel << "ms, " << serial / parallel << "x"
+        << (matches ? "" : ", wrong result") << std::endl;
+}
+
+int main()
+{
+    std::mt19937 gen(1);
+
+    // small values so the int sums of 100M elements do not overflow
+    std::uniform_int_distribution<> intDis(-10, 10);
+    std::vector<int> ints(NUM_ELEMENTS);
+    std::generate(ints.begin(), ints.end(), [&] { return intDis(gen); });
+
+    // multiples of 1/8 with sums far below 2^21, every partial sum is exact in any order
+    std::vector<float> floats(NUM_ELEMENTS);
+    std::generate(floats.begin(), floats.end(), [&] { return intDis(gen) / 8.0f; });
+
+    std::cout << NUM_ELEMENTS << " ints, inclusive scan" << std::endl;
+    BenchInclusiveScan(ints);
+
+    std::cout << NUM_ELEMENTS << " floats, inclusive scan" << std::endl;
+    BenchInclusiveScan(floats);
+
+    std::cout << NUM_ELEMENTS << " ints, stream compaction, " << thread_pool::Default().Size() + 1 << " threads" << std::endl;
+    BenchCompaction(ints);
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
+
+#include "parallel_for.h"
+#include "parallel_sort.h"
+#include "radix_sort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Argsort: the permutation that sorts a range, without moving the range itself,
+and the gather that applies such a permutation
+*/
+
+/*
+Output elements gathered per task, the block being written stays in cache
+*/
+constexpr std::size_t ApplyPermutationBlockSize = 1 << 12;
+
+/*
+How many elements ahead the gather prefetches its random reads
+*/
+constexpr std::size_t ApplyPermutationPrefetchDistance = 16;
+
+inline void PrefetchForRead(const void* address)
+{
+#if defined(_MSC_VER)
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(address);
+#endif
+}
+
+/*
+Parallel stable argsort: returns p such that first[p[0]], first[p[1]], ... is
+sorted, equal keys keep the order of their indices
+
+The keys are packed into (key, index) pairs, which are sorted with
+parallel_radix_sort for integer, float and double keys under std::less and
+with parallel_stable_sort otherwise, then the indices are unpacked.
+For a matrix: parallel_argsort(pool, m.Raw().begin(), m.Raw().end()).
+*/
+template <typename RandomIt, typename Compare>
+std::vector<std::size_t> parallel_argsort(thread_pool& pool, RandomIt first, RandomIt last, Compare comp,
+    const stop_token& token = stop_token())
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type key_type;
+    typedef std::pair<key_type, std::size_t> keyed_index;
+
+    const auto n = static_cast<std::size_t>(last - first);
+    std::vector<keyed_index> pairs(n);
+    parallel_for(pool, std::size_t(0), n, [&](std::size_t chunkFirst, std::size_t chunkLast)
+    {
+        for (auto i = chunkFirst; i < chunkLast; ++i)
+        {
+            pairs[i] = keyed_index(first[i], i);
+        }
+    }, token);
+
+    constexpr auto radixKey = std::is_integral<key_type>::value || std::is_same<key_type, float>::value
+        || std::is_same<key_type, double>::value;
+    constexpr auto ascending = std::is_same<Compare, std::less<>>::value || std::is_same<Compare, std::less<key_type>>::value;
+    if constexpr (radixKey && ascending)
+    {
+        // -0.0 has its own bit pattern but compares equal to +0.0, as +0.0 it keeps its index order like any equal key
+        parallel_radix_sort(pool, pairs.begin(), pairs.end(), [](const keyed_index& p)
+        {
+            return (p.first == key_type(0)) ? key_type(0) : p.first;
+        }, token);
+    }
+    else
+    {
+        parallel_stable_sort(pool, pairs.begin(), pairs.end(), comp,
+            [](const keyed_index& p) -> const key_type& { return p.first; }, token);
+    }
+
+    std::vector<std::size_t> permutation(n);
+    parallel_for(pool, std::size_t(0), n, [&](std::size_t chunkFirst, std::size_t chunkLast)
+    {
+        for (auto i = chunkFirst; i < chunkLast; ++i)
+        {
+            permutation[i] = pairs[i].second;
+        }
+    }, token);
+    return permutation;
+}
+
+template <typename RandomIt>
+std::vector<std::size_t> parallel_argsort(thread_pool& pool, RandomIt first, RandomIt last)
+{
+    return parallel_argsort(pool, first, last, std::less<>());
+}
+
+template <typename RandomIt, typename Compare>
+std::vector<std::size_t> parallel_argsort(RandomIt first, RandomIt last, Compare comp, const stop_token& token = stop_token())
+{
+    return parallel_argsort(thread_pool::Default(), first, last, comp, token);
+}
+
+template <typename RandomIt>
+std::vector<std::size_t> parallel_argsort(RandomIt first, RandomIt last)
+{
+    return parallel_argsort(thread_pool::Default(), first, last, std::less<>());
+}
+
+/*
+Parallel gather, out[i] = source[permutation[i]], out must not overlap source
+
+The output is cut into blocks of ApplyPermutationBlockSize, each written
+sequentially by one task, while the scattered reads are prefetched
+ApplyPermutationPrefetchDistance elements ahead so their cache misses overlap.
+*/
+template <typename RandomIt, typename OutputIt>
+void apply_permutation(thread_pool& pool, RandomIt source, const std::vector<std::size_t>& permutation, OutputIt out,
+    const stop_token& token = stop_token())
+{
+    parallel_for(pool, std::size_t(0), permutation.size(), ApplyPermutationBlockSize,
+        [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto i = blockFirst; i < blockLast; ++i)
+        {
+            if (i + ApplyPermutationPrefetchDistance < blockLast)
+            {
+                PrefetchForRead(std::addressof(source[permutation[i + ApplyPermutationPrefetchDistance]]));
+            }
+            out[i] = source[permutation[i]];
+        }
+    }, token);
+}
+
+/*
+Reorders data by permutation, through a temporary copy
+*/
+template <typename T>
+void apply_permutation(thread_pool& pool, std::vector<T>& data, const std::vector<std::size_t>& permutation,
+    const stop_token& token = stop_token())
+{
+    std::vector<T> gathered(permutation.size());
+    apply_permutation(pool, data.cbegin(), permutation, gathered.begin(), token);
+    data.swap(gathered);
+}
+
+template <typename RandomIt, typename OutputIt>
+void apply_permutation(RandomIt source, const std::vector<std::size_t>& permutation, OutputIt out,
+    const stop_token& token = stop_token())
+{
+    apply_permutation(thread_pool::Default(), source, permutation, out, token);
+}
+
+template <typename T>
+void apply_permutation(std::vector<T>& data, const std::vector<std::size_t>& permutation, const stop_token& token = stop_token())
+{
+    apply_permutation(thread_pool::Default(), data, permutation, token);
+}
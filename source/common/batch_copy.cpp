@@ -0,0 +1,653 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "batch_copy.h"
+#include "file_copy.h"
+#include "parallel_for.h"
+
+namespace
+{
+    batch_copy_result CopyOnPool(thread_pool& pool, const std::vector<batch_copy_task>& tasks, const stop_token& token)
+    {
+        std::atomic<std::uint64_t> bytes(0);
+        parallel_for(pool, std::size_t(0), tasks.size(), std::size_t(1), [&](std::size_t first, std::size_t last)
+        {
+            for (auto i = first; i < last; ++i)
+            {
+                bytes += CopyFileZeroCopy(tasks[i].source, tasks[i].destination, token).bytes;
+            }
+        }, token);
+
+        batch_copy_result result;
+        result.files = tasks.size();
+        result.bytes = bytes;
+        return result;
+    }
+
+#if defined(__linux__)
+    [[noreturn]] void ThrowErrno(int error, const std::string& what)
+    {
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    int IoUringSetup(unsigned int entries, io_uring_params& params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+
+    /*
+    Submission and completion queues of one io_uring instance, shared with the
+    kernel through mmap
+    */
+    class io_ring
+    {
+    private:
+        int _fd;
+        void* _sqRing = MAP_FAILED;
+        std::size_t _sqRingSize = 0;
+        void* _cqRing = MAP_FAILED;
+        std::size_t _cqRingSize = 0;
+        io_uring_sqe* _sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        std::size_t _sqesSize = 0;
+
+        unsigned int* _sqTail;
+        unsigned int _sqMask;
+        unsigned int* _sqArray;
+        unsigned int _sqEntries;
+        unsigned int* _cqHead;
+        unsigned int* _cqTail;
+        unsigned int _cqMask;
+        io_uring_cqe* _cqes;
+
+        unsigned int _unsubmitted = 0;
+
+        static void* Map(std::size_t size, int fd, off_t offset)
+        {
+            return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        }
+
+        template <typename T>
+        T* At(void* ring, std::uint32_t offset)
+        {
+            return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+        }
+
+        void Unmap()
+        {
+            if (_sqes != MAP_FAILED)
+            {
+                munmap(_sqes, _sqesSize);
+            }
+            if (_cqRing != MAP_FAILED && _cqRing != _sqRing)
+            {
+                munmap(_cqRing, _cqRingSize);
+            }
+            if (_sqRing != MAP_FAILED)
+            {
+                munmap(_sqRing, _sqRingSize);
+            }
+        }
+
+    public:
+        explicit io_ring(unsigned int entries)
+        {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            params.flags = IORING_SETUP_CLAMP; // more entries than the kernel allows are cut down instead of failing
+            _fd = IoUringSetup(entries, params);
+            if (_fd < 0)
+            {
+                ThrowErrno(errno, "io_uring_setup");
+            }
+
+            _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+            _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+            }
+            _sqRing = Map(_sqRingSize, _fd, IORING_OFF_SQ_RING);
+            _cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? _sqRing : Map(_cqRingSize, _fd, IORING_OFF_CQ_RING);
+            _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            _sqes = static_cast<io_uring_sqe*>(Map(_sqesSize, _fd, IORING_OFF_SQES));
+            if (_sqRing == MAP_FAILED || _cqRing == MAP_FAILED || _sqes == MAP_FAILED)
+            {
+                const auto error = errno;
+                Unmap();
+                close(_fd);
+                ThrowErrno(error, "io_uring mmap");
+            }
+
+            _sqTail = At<unsigned int>(_sqRing, params.sq_off.tail);
+            _sqMask = *At<unsigned int>(_sqRing, params.sq_off.ring_mask);
+            _sqArray = At<unsigned int>(_sqRing, params.sq_off.array);
+            _sqEntries = params.sq_entries;
+            _cqHead = At<unsigned int>(_cqRing, params.cq_off.head);
+            _cqTail = At<unsigned int>(_cqRing, params.cq_off.tail);
+            _cqMask = *At<unsigned int>(_cqRing, params.cq_off.ring_mask);
+            _cqes = At<io_uring_cqe>(_cqRing, params.cq_off.cqes);
+        }
+
+        ~io_ring()
+        {
+            Unmap();
+            close(_fd);
+        }
+
+        io_ring(const io_ring&) = delete;
+        io_ring& operator=(const io_ring&) = delete;
+
+        unsigned int Entries() const
+        {
+            return _sqEntries;
+        }
+
+        int Register(unsigned int opcode, const void* arg, unsigned int count)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_register, _fd, opcode, arg, count));
+        }
+
+        /*
+        Next free submission entry, cleared; the caller keeps at most Entries()
+        requests in flight so there always is one
+        */
+        io_uring_sqe& NextSqe()
+        {
+            const auto tail = *_sqTail + _unsubmitted;
+            const auto index = tail & _sqMask;
+            _sqArray[index] = index;
+            ++_unsubmitted;
+            std::memset(&_sqes[index], 0, sizeof(io_uring_sqe));
+            return _sqes[index];
+        }
+
+        /*
+        Hands the new entries to the kernel and waits until at least one
+        request has completed
+        */
+        void SubmitAndWait()
+        {
+            __atomic_store_n(_sqTail, *_sqTail + _unsubmitted, __ATOMIC_RELEASE);
+            auto toSubmit = _unsubmitted;
+            _unsubmitted = 0;
+            for (;;)
+            {
+                const auto result = syscall(__NR_io_uring_enter, _fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (result >= 0)
+                {
+                    toSubmit -= std::min(toSubmit, static_cast<unsigned int>(result));
+                    if (toSubmit == 0)
+                    {
+                        return;
+                    }
+                }
+                else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                    ThrowErrno(errno, "io_uring_enter");
+                }
+            }
+        }
+
+        template <typename Handler>
+        void ForEachCompletion(const Handler& handler)
+        {
+            auto head = *_cqHead;
+            const auto tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head)
+            {
+                const auto cqe = _cqes[head & _cqMask];
+                __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+                handler(cqe.user_data, cqe.res);
+            }
+        }
+    };
+
+    /*
+    Copies a list of files through one ring on the calling thread
+    */
+    class ring_copy
+    {
+    private:
+        struct open_file
+        {
+            std::size_t task = 0;
+            int in = -1;
+            int out = -1;
+            std::uint64_t size = 0;
+            std::uint64_t scheduled = 0;
+            std::uint64_t done = 0;
+        };
+
+        struct io_slot
+        {
+            unsigned int file = 0;
+            std::uint64_t offset = 0;
+            unsigned int length = 0;
+            unsigned int progress = 0; // of the current read or write
+            bool writing = false;
+        };
+
+        const std::vector<batch_copy_task>& _tasks;
+        const std::vector<std::size_t>& _taskIndices;
+        const batch_copy_options& _options;
+        const stop_token& _token;
+
+        std::vector<char> _buffers; // outlives the ring, the kernel may still use it until the ring is closed
+        io_ring _ring;
+        bool _fixedBuffers = false;
+        bool _fixedFiles = false;
+
+        std::vector<open_file> _files;
+        std::vector<unsigned int> _freeFiles;
+        std::vector<io_slot> _slots;
+        std::vector<unsigned int> _freeSlots;
+        unsigned int _inFlight = 0;
+        std::size_t _nextTask = 0;
+        unsigned int _filling; // open file that still has chunks to schedule, or none
+        std::exception_ptr _error;
+
+        static constexpr unsigned int NoFile = ~0u;
+
+        batch_copy_result _result;
+
+        char* Buffer(unsigned int slot)
+        {
+            return _buffers.data() + slot * _options.bufferSize;
+        }
+
+        bool SetFixedFiles(unsigned int file, int in, int out)
+        {
+            if (!_fixedFiles)
+            {
+                return true;
+            }
+            int fds[2] = { in, out };
+            io_uring_files_update update;
+            std::memset(&update, 0, sizeof(update));
+            update.offset = 2 * file;
+            update.fds = reinterpret_cast<std::uint64_t>(fds);
+            return _ring.Register(IORING_REGISTER_FILES_UPDATE, &update, 2) >= 0;
+        }
+
+        void CloseFile(unsigned int file)
+        {
+            auto& f = _files[file];
+            if (f.in >= 0)
+            {
+                SetFixedFiles(file, -1, -1);
+                close(f.in);
+                close(f.out);
+            }
+            f.in = f.out = -1;
+            _freeFiles.push_back(file);
+        }
+
+        /*
+        Opens the next task into a free file entry, empty files are finished
+        right away. Returns false when there is nothing left to open.
+        */
+        bool OpenNext()
+        {
+            while (_nextTask < _taskIndices.size() && !_freeFiles.empty())
+            {
+                const auto task = _taskIndices[_nextTask++];
+                const auto& paths = _tasks[task];
+
+                const auto in = open(paths.source.c_str(), O_RDONLY | O_CLOEXEC);
+                if (in < 0)
+                {
+                    ThrowErrno(errno, "cannot open " + paths.source);
+                }
+                struct stat info;
+                if (fstat(in, &info) != 0)
+                {
+                    const auto error = errno;
+                    close(in);
+                    ThrowErrno(error, "cannot stat " + paths.source);
+                }
+                const auto permissions = static_cast<mode_t>(info.st_mode & 07777);
+                const auto out = open(paths.destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, permissions);
+                if (out < 0 || fchmod(out, permissions) != 0)
+                {
+                    const auto error = errno;
+                    close(in);
+                    if (out >= 0)
+                    {
+                        close(out);
+                    }
+                    ThrowErrno(error, "cannot open " + paths.destination);
+                }
+
+                const auto size = static_cast<std::uint64_t>(info.st_size);
+                if (size == 0)
+                {
+                    close(in);
+                    close(out);
+                    ++_result.files;
+                    continue;
+                }
+                if (fallocate(out, 0, 0, static_cast<off_t>(size)) != 0)
+                {
+                    ftruncate(out, static_cast<off_t>(size));
+                }
+
+                const auto file = _freeFiles.back();
+                _freeFiles.pop_back();
+                _files[file] = { task, in, out, size, 0, 0 };
+                if (!SetFixedFiles(file, in, out))
+                {
+                    ThrowErrno(errno, "cannot register " + paths.source + " with io_uring");
+                }
+                _filling = file;
+                return true;
+            }
+            return false;
+        }
+
+        void Submit(unsigned int slot)
+        {
+            const auto& s = _slots[slot];
+            const auto& f = _files[s.file];
+            auto& sqe = _ring.NextSqe();
+            if (_fixedBuffers)
+            {
+                sqe.opcode = s.writing ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+                sqe.buf_index = static_cast<std::uint16_t>(slot);
+            }
+            else
+            {
+                sqe.opcode = s.writing ? IORING_OP_WRITE : IORING_OP_READ;
+            }
+            if (_fixedFiles)
+            {
+                sqe.fd = static_cast<std::int32_t>(2 * s.file + (s.writing ? 1 : 0));
+                sqe.flags = IOSQE_FIXED_FILE;
+            }
+            else
+            {
+                sqe.fd = s.writing ? f.out : f.in;
+            }
+            sqe.addr = reinterpret_cast<std::uint64_t>(Buffer(slot) + s.progress);
+            sqe.len = s.length - s.progress;
+            sqe.off = s.offset + s.progress;
+            sqe.user_data = slot;
+            ++_inFlight;
+        }
+
+        /*
+        Starts reads into free buffers while there are chunks left
+        */
+        void Fill()
+        {
+            while (!_freeSlots.empty() && !_error && !_token.StopRequested())
+            {
+                if (_filling == NoFile && !OpenNext())
+                {
+                    return;
+                }
+                auto& f = _files[_filling];
+                const auto slot = _freeSlots.back();
+                _freeSlots.pop_back();
+                auto& s = _slots[slot];
+                s.file = _filling;
+                s.offset = f.scheduled;
+                s.length = static_cast<unsigned int>(std::min<std::uint64_t>(_options.bufferSize, f.size - f.scheduled));
+                s.progress = 0;
+                s.writing = false;
+                f.scheduled += s.length;
+                if (f.scheduled == f.size)
+                {
+                    _filling = NoFile;
+                }
+                Submit(slot);
+            }
+        }
+
+        void Complete(unsigned int slot, int result)
+        {
+            --_inFlight;
+            auto& s = _slots[slot];
+            auto& f = _files[s.file];
+            const auto& paths = _tasks[f.task];
+            if (result <= 0)
+            {
+                if (!_error)
+                {
+                    _error = (result == 0)
+                        ? std::make_exception_ptr(std::runtime_error(paths.source + " was truncated while being copied"))
+                        : std::make_exception_ptr(std::system_error(-result, std::generic_category(),
+                            (s.writing ? "cannot write " + paths.destination : "cannot read " + paths.source)));
+                }
+                _freeSlots.push_back(slot);
+                return;
+            }
+
+            s.progress += static_cast<unsigned int>(result);
+            if (s.progress < s.length)
+            {
+                Submit(slot); // short read or write, the rest goes again
+                return;
+            }
+            if (!s.writing)
+            {
+                s.writing = true;
+                s.progress = 0;
+                Submit(slot);
+                return;
+            }
+
+            f.done += s.length;
+            _result.bytes += s.length;
+            _freeSlots.push_back(slot);
+            if (f.done == f.size)
+            {
+                ++_result.files;
+                CloseFile(s.file);
+            }
+        }
+
+        static unsigned int QueueDepth(const batch_copy_options& options)
+        {
+            const auto fitting = std::max<std::size_t>(1, BatchCopyMaxBufferMemory / options.bufferSize);
+            return static_cast<unsigned int>(std::min<std::size_t>(std::max(options.queueDepth, 1u), fitting));
+        }
+
+    public:
+        ring_copy(const std::vector<batch_copy_task>& tasks, const std::vector<std::size_t>& taskIndices,
+            const batch_copy_options& options, const stop_token& token) :
+            _tasks(tasks), _taskIndices(taskIndices), _options(options), _token(token),
+            _ring(QueueDepth(options)), _filling(NoFile)
+        {
+            const auto numSlots = std::min(QueueDepth(options), _ring.Entries());
+            _buffers.resize(numSlots * options.bufferSize);
+            _slots.resize(numSlots);
+            for (auto slot = numSlots; slot > 0; --slot)
+            {
+                _freeSlots.push_back(slot - 1);
+            }
+            const auto numFiles = std::max(options.maxOpenFiles, 1u);
+            _files.resize(numFiles);
+            for (auto file = numFiles; file > 0; --file)
+            {
+                _freeFiles.push_back(file - 1);
+            }
+
+            // both registrations are optimizations, the copy works without them
+            std::vector<iovec> buffers(numSlots);
+            for (auto slot = 0u; slot < numSlots; ++slot)
+            {
+                buffers[slot].iov_base = Buffer(slot);
+                buffers[slot].iov_len = options.bufferSize;
+            }
+            _fixedBuffers = _ring.Register(IORING_REGISTER_BUFFERS, buffers.data(), numSlots) == 0;
+
+            const std::vector<int> sparse(2 * numFiles, -1);
+            _fixedFiles = _ring.Register(IORING_REGISTER_FILES, sparse.data(), 2 * numFiles) == 0;
+        }
+
+        ~ring_copy()
+        {
+            for (auto& f : _files)
+            {
+                if (f.in >= 0)
+                {
+                    close(f.in);
+                    close(f.out);
+                }
+            }
+        }
+
+        ring_copy(const ring_copy&) = delete;
+        ring_copy& operator=(const ring_copy&) = delete;
+
+        batch_copy_result Run()
+        {
+            _result.usedIoUring = true;
+            for (;;)
+            {
+                try
+                {
+                    Fill();
+                }
+                catch (...)
+                {
+                    // let the requests in flight finish before reporting
+                    if (!_error)
+                    {
+                        _error = std::current_exception();
+                    }
+                }
+                if (_inFlight == 0)
+                {
+                    break;
+                }
+
+                _ring.SubmitAndWait();
+                _ring.ForEachCompletion([this](std::uint64_t slot, int result)
+                {
+                    Complete(static_cast<unsigned int>(slot), result);
+                });
+            }
+
+            if (_error)
+            {
+                std::rethrow_exception(_error);
+            }
+            _token.ThrowIfStopRequested();
+            return _result;
+        }
+    };
+#endif
+}
+
+bool IoUringAvailable()
+{
+#if defined(__linux__)
+    static const bool available = []
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        const auto fd = IoUringSetup(1, params);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        // kernels before 5.6 create the ring but reject READ and WRITE, they have no probe either
+        std::vector<char> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        const auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        const auto probed = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+        close(fd);
+        const auto supported = [&](unsigned int opcode)
+        {
+            return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+        };
+        return probed && supported(IORING_OP_READ) && supported(IORING_OP_WRITE)
+            && supported(IORING_OP_READ_FIXED) && supported(IORING_OP_WRITE_FIXED);
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+batch_copy_result CopyFilesBatched(thread_pool& pool, const std::vector<batch_copy_task>& tasks,
+    const batch_copy_options& options, const stop_token& token)
+{
+    if (options.bufferSize == 0 || options.bufferSize > (std::size_t(1) << 30))
+    {
+        throw std::invalid_argument("bufferSize must be between 1 byte and 1GB");
+    }
+    if (!IoUringAvailable())
+    {
+        return CopyOnPool(pool, tasks, token);
+    }
+
+#if defined(__linux__)
+    // dealt out round-robin, neighbouring files (often of similar size) go to different rings
+    const auto numRings = std::max(1u, std::min(options.numRings, static_cast<unsigned int>(tasks.size())));
+    std::vector<std::vector<std::size_t>> taskIndices(numRings);
+    for (auto i = std::size_t(0); i < tasks.size(); ++i)
+    {
+        taskIndices[i % numRings].push_back(i);
+    }
+
+    // set up before any file is opened: a ring the kernel refuses (older kernels count it against the
+    // locked memory limit) leaves the whole copy to the pool
+    std::vector<std::unique_ptr<ring_copy>> rings;
+    try
+    {
+        for (auto ring = 0u; ring < numRings; ++ring)
+        {
+            rings.push_back(std::make_unique<ring_copy>(tasks, taskIndices[ring], options, token));
+        }
+    }
+    catch (const std::system_error&)
+    {
+        rings.clear();
+        return CopyOnPool(pool, tasks, token);
+    }
+
+    std::vector<batch_copy_result> results(numRings);
+    parallel_for(pool, 0u, numRings, 1u, [&](unsigned int first, unsigned int last)
+    {
+        for (auto ring = first; ring < last; ++ring)
+        {
+            results[ring] = rings[ring]->Run();
+        }
+    }, token);
+
+    batch_copy_result result;
+    result.usedIoUring = true;
+    for (const auto& r : results)
+    {
+        result.files += r.files;
+        result.bytes += r.bytes;
+    }
+    return result;
+#else
+    return CopyOnPool(pool, tasks, token);
+#endif
+}
+
+batch_copy_result CopyFilesBatched(const std::vector<batch_copy_task>& tasks)
+{
+    return CopyFilesBatched(thread_pool::Default(), tasks);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Copy of many files with a deep queue of asynchronous reads and writes
+
+A thread per file blocks on every read and write, so the device never sees
+more requests than there are threads. With io_uring (Linux 5.6+) a single
+thread keeps queueDepth requests in flight instead:
+- the ring holds queueDepth buffers of bufferSize bytes, registered with the
+  kernel once so no request has to map its buffer (READ_FIXED, WRITE_FIXED)
+- every buffer goes around read, write, read ... over the chunks of the files,
+  up to maxOpenFiles files are open at a time and all of them make progress
+- open files sit in a registered file table (fixed files), requests refer to
+  them by index and the kernel skips the file lookup
+Short reads and writes are resubmitted for the rest. Registered buffers and
+fixed files are optional, without them plain READ/WRITE requests are used. A
+queueDepth above what the kernel allows (32768 entries) is clamped to it, and so
+is one whose buffers would take more than BatchCopyMaxBufferMemory per ring.
+
+With numRings > 1 the files are dealt out to that many rings, each driven by
+its own pool thread. Where io_uring is not available (other OSes, old kernels,
+containers that forbid it, or a ring that cannot be set up) the files are
+copied on the pool, one file per task with CopyFileZeroCopy.
+*/
+
+struct batch_copy_task
+{
+    std::string source;
+    std::string destination;
+};
+
+struct batch_copy_options
+{
+    unsigned int queueDepth = 64;
+    std::size_t bufferSize = std::size_t(256) << 10;
+    unsigned int maxOpenFiles = 64;
+    unsigned int numRings = 1;
+};
+
+/*
+Most bytes of buffers one ring allocates; the queue depth is lowered until
+queueDepth x bufferSize fits, down to a single buffer
+*/
+constexpr std::size_t BatchCopyMaxBufferMemory = std::size_t(256) << 20;
+
+struct batch_copy_result
+{
+    std::uint64_t files = 0;
+    std::uint64_t bytes = 0;
+    bool usedIoUring = false;
+};
+
+/*
+Whether this process can create an io_uring instance that supports the read
+and write requests the copy needs, checked once
+*/
+bool IoUringAvailable();
+
+/*
+Copies every task's source to its destination (created or truncated, with the
+source's permissions). Throws std::system_error for the first file that cannot
+be opened, read or written and operation_cancelled when the token is stopped,
+after the requests in flight have completed.
+*/
+batch_copy_result CopyFilesBatched(thread_pool& pool, const std::vector<batch_copy_task>& tasks,
+    const batch_copy_options& options = batch_copy_options(), const stop_token& token = stop_token());
+
+batch_copy_result CopyFilesBatched(const std::vector<batch_copy_task>& tasks);
@@ -0,0 +1,91 @@
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32C_HARDWARE 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#include "crc32c.h"
+
+namespace
+{
+    const std::array<std::uint32_t, 256>& Crc32cTable()
+    {
+        static const auto table = []
+        {
+            std::array<std::uint32_t, 256> t;
+            for (auto i = 0u; i < 256; ++i)
+            {
+                auto crc = i;
+                for (auto bit = 0; bit < 8; ++bit)
+                {
+                    crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+                }
+                t[i] = crc;
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    std::uint32_t Crc32cTableLookup(std::uint32_t crc, const unsigned char* bytes, std::size_t size)
+    {
+        const auto& table = Crc32cTable();
+        for (; size > 0; --size, ++bytes)
+        {
+            crc = (crc >> 8) ^ table[(crc ^ *bytes) & 0xFF];
+        }
+        return crc;
+    }
+
+#if defined(CRC32C_HARDWARE)
+    bool HasSse42()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    }
+
+    // compiled for SSE4.2 whatever the rest of the build targets, only called when the CPU has it
+#if !defined(_MSC_VER)
+    __attribute__((target("sse4.2")))
+#endif
+    std::uint32_t Crc32cInstruction(std::uint32_t crc, const unsigned char* bytes, std::size_t size)
+    {
+        std::uint64_t crc64 = crc;
+        for (; size >= 8; size -= 8, bytes += 8)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, bytes, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<std::uint32_t>(crc64);
+        for (; size > 0; --size, ++bytes)
+        {
+            crc = _mm_crc32_u8(crc, *bytes);
+        }
+        return crc;
+    }
+#endif
+}
+
+std::uint32_t Crc32c(std::uint32_t crc, const void* data, std::size_t size)
+{
+    const auto bytes = static_cast<const unsigned char*>(data);
+#if defined(CRC32C_HARDWARE)
+    static const auto hardware = HasSse42();
+    if (hardware)
+    {
+        return ~Crc32cInstruction(~crc, bytes, size);
+    }
+#endif
+    return ~Crc32cTableLookup(~crc, bytes, size);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+CRC32C (Castagnoli polynomial, as in iSCSI, ext4 and btrfs)
+
+SSE4.2 has an instruction for exactly this CRC. Where the CPU has it (checked
+once at run time, no compiler flag needed) Crc32c feeds it 8 bytes at a time,
+several GB/s on one core, far more than a disk delivers, so hashing the buffers
+of a copy on the way through does not slow it down. Other CPUs get a byte-wise
+table lookup.
+
+Crc32c(0, data, size) is the checksum of the data, chained calls continue it:
+Crc32c(Crc32c(0, a, n), b, m) is the checksum of a followed by b.
+*/
+
+std::uint32_t Crc32c(std::uint32_t crc, const void* data, std::size_t size);
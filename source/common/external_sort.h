@@ -0,0 +1,456 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "loser_tree.h"
+#include "parallel_for.h"
+#include "parallel_quicksort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+External merge sort of binary files of fixed-size records
+
+The input is a plain array of T on disk, larger than memory. It is cut into
+runs that fit the memory budget, every run is sorted in memory with
+parallel_quicksort and written to a temp file, and the runs are then merged
+into the output with a k-way merge (loser_tree.h).
+
+All file I/O is double buffered: while one buffer is sorted or merged the
+other one is read or written by an async task, so the disk and the CPUs are
+busy at the same time. The reads and writes run on their own threads
+(std::async) rather than on the pool, a blocked read must not take a worker
+away from the sort.
+*/
+
+struct external_sort_options
+{
+    // bytes of record buffers in use at any time, while forming runs and while merging
+    std::size_t memoryBudget = std::size_t(256) << 20;
+
+    // where the sorted runs go, the files are removed again when the sort returns
+    std::string tempDirectory = ".";
+};
+
+struct external_sort_stats
+{
+    std::size_t numRecords = 0;
+    std::size_t numRuns = 0;
+    unsigned int numMergePasses = 0;
+};
+
+/*
+Merge buffers are never smaller than this many bytes. When the budget cannot
+give every run that much, the runs are merged over several passes.
+*/
+constexpr std::size_t ExternalSortMinBlockSize = 1 << 16;
+
+inline std::ifstream OpenForReading(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("cannot open " + path + " for reading");
+    }
+    return file;
+}
+
+inline std::ofstream OpenForWriting(const std::string& path)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("cannot open " + path + " for writing");
+    }
+    return file;
+}
+
+/*
+Reads up to count records, returns how many were read (fewer only at the end of the file)
+*/
+template <typename T>
+std::size_t ReadRecords(std::ifstream& file, T* data, std::size_t count)
+{
+    file.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+    if (file.bad())
+    {
+        throw std::runtime_error("read error");
+    }
+    return static_cast<std::size_t>(file.gcount()) / sizeof(T);
+}
+
+template <typename T>
+void WriteRecords(std::ofstream& file, const T* data, std::size_t count)
+{
+    file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+    if (!file)
+    {
+        throw std::runtime_error("write error");
+    }
+}
+
+/*
+Sequential reader of a run file, the next block is read while the current one is consumed
+*/
+template <typename T>
+class external_run_reader
+{
+private:
+    std::ifstream _file;
+    std::vector<T> _current;
+    std::vector<T> _next;
+    std::size_t _size;
+    std::size_t _position;
+    std::future<std::size_t> _pending;
+
+    void StartRead()
+    {
+        _pending = std::async(std::launch::async, [this] { return ReadRecords(_file, _next.data(), _next.size()); });
+    }
+
+    void Refill()
+    {
+        _size = 0;
+        _position = 0;
+        if (!_pending.valid())
+        {
+            return; // the last block was short, the file is done
+        }
+
+        _size = _pending.get();
+        std::swap(_current, _next);
+        if (_size == _current.size())
+        {
+            StartRead();
+        }
+    }
+
+public:
+    external_run_reader(const std::string& path, std::size_t blockLength)
+        : _file(OpenForReading(path)), _current(blockLength), _next(blockLength), _size(0), _position(0)
+    {
+        StartRead();
+        Refill();
+    }
+
+    ~external_run_reader()
+    {
+        // the read task uses the buffers and the stream
+        if (_pending.valid())
+        {
+            _pending.wait();
+        }
+    }
+
+    external_run_reader(const external_run_reader&) = delete;
+    external_run_reader& operator=(const external_run_reader&) = delete;
+
+    bool Empty() const
+    {
+        return _position == _size;
+    }
+
+    const T& Front() const
+    {
+        return _current[_position];
+    }
+
+    void Pop()
+    {
+        if (++_position == _size)
+        {
+            Refill();
+        }
+    }
+};
+
+/*
+Sequential writer of a run file, a full block is written while the next one is filled
+*/
+template <typename T>
+class external_run_writer
+{
+private:
+    std::ofstream _file;
+    std::vector<T> _current;
+    std::vector<T> _writing;
+    std::size_t _size;
+    std::future<void> _pending;
+
+    void Flush()
+    {
+        if (_pending.valid())
+        {
+            _pending.get();
+        }
+        if (_size == 0)
+        {
+            return;
+        }
+
+        std::swap(_current, _writing);
+        const auto count = _size;
+        _size = 0;
+        _pending = std::async(std::launch::async, [this, count] { WriteRecords(_file, _writing.data(), count); });
+    }
+
+public:
+    external_run_writer(const std::string& path, std::size_t blockLength)
+        : _file(OpenForWriting(path)), _current(blockLength), _writing(blockLength), _size(0)
+    {
+    }
+
+    ~external_run_writer()
+    {
+        if (_pending.valid())
+        {
+            _pending.wait();
+        }
+    }
+
+    external_run_writer(const external_run_writer&) = delete;
+    external_run_writer& operator=(const external_run_writer&) = delete;
+
+    void Push(const T& value)
+    {
+        _current[_size] = value;
+        if (++_size == _current.size())
+        {
+            Flush();
+        }
+    }
+
+    /*
+    Writes what is left and waits for it, errors surface here
+    */
+    void Close()
+    {
+        Flush();
+        if (_pending.valid())
+        {
+            _pending.get();
+        }
+        _file.close();
+        if (!_file)
+        {
+            throw std::runtime_error("write error");
+        }
+    }
+};
+
+/*
+Temp files of one sort, whatever is left is removed on destruction
+
+Names carry a random id and a per-process count, so sorts sharing a
+directory, in this process or in others, never open each other's runs.
+*/
+class external_sort_temp_files
+{
+private:
+    std::string _prefix;
+    std::vector<std::string> _paths;
+
+    static std::string UniqueId()
+    {
+        static std::atomic<unsigned int> count(0);
+        std::random_device random;
+        char id[32];
+        std::snprintf(id, sizeof(id), "%08x%08x_%u", random(), random(), count++);
+        return id;
+    }
+
+public:
+    explicit external_sort_temp_files(const std::string& directory)
+        : _prefix(directory + "/external_sort_" + UniqueId() + "_")
+    {
+    }
+
+    ~external_sort_temp_files()
+    {
+        for (const auto& path : _paths)
+        {
+            std::remove(path.c_str());
+        }
+    }
+
+    external_sort_temp_files(const external_sort_temp_files&) = delete;
+    external_sort_temp_files& operator=(const external_sort_temp_files&) = delete;
+
+    std::string Create(unsigned int pass, std::size_t run)
+    {
+        _paths.push_back(_prefix + std::to_string(pass) + "_" + std::to_string(run) + ".run");
+        return _paths.back();
+    }
+
+    void Remove(const std::string& path)
+    {
+        std::remove(path.c_str());
+        _paths.erase(std::find(_paths.begin(), _paths.end(), path));
+    }
+};
+
+/*
+Merges sorted run files into one, equal records keep the order of the runs
+*/
+template <typename T, typename Compare>
+void MergeRunFiles(const std::vector<std::string>& inputs, const std::string& output, Compare comp,
+    std::size_t blockLength, const stop_token& token)
+{
+    std::vector<std::unique_ptr<external_run_reader<T>>> readers;
+    readers.reserve(inputs.size());
+    for (const auto& path : inputs)
+    {
+        readers.push_back(std::make_unique<external_run_reader<T>>(path, blockLength));
+    }
+    external_run_writer<T> writer(output, blockLength);
+
+    auto less = [&](std::size_t a, std::size_t b)
+    {
+        if (readers[a]->Empty())
+        {
+            return false;
+        }
+        if (readers[b]->Empty())
+        {
+            return true;
+        }
+        return LoserTreeHeadLess(a, readers[a]->Front(), b, readers[b]->Front(), comp);
+    };
+    loser_tree<decltype(less)> tree(readers.size(), less);
+
+    auto numMerged = std::size_t(0);
+    for (auto i = tree.Winner(); !readers[i]->Empty(); i = tree.Winner())
+    {
+        if ((++numMerged & 0xffff) == 0)
+        {
+            token.ThrowIfStopRequested();
+        }
+
+        writer.Push(readers[i]->Front());
+        readers[i]->Pop();
+        tree.ReplayWinner();
+    }
+    writer.Close();
+}
+
+/*
+Sorts the records in the file at inputPath into the file at outputPath
+
+1. Runs of memoryBudget / 2 bytes are read, sorted with parallel_quicksort
+   and written to tempDirectory; the next run is read while one is sorted
+2. The runs are merged with a loser tree, every run and the output getting two
+   blocks of the remaining budget. If that would make the blocks smaller
+   than ExternalSortMinBlockSize, groups of runs are merged into longer runs
+   first, so a pass never has more runs than the budget can feed.
+
+T must be trivially copyable, the files are raw arrays of it. The sort is
+not stable. Once cancelled (operation_cancelled) the output is incomplete;
+the temp files are removed either way.
+*/
+template <typename T, typename Compare>
+external_sort_stats external_sort(thread_pool& pool, const std::string& inputPath, const std::string& outputPath,
+    Compare comp, const external_sort_options& options = external_sort_options(), const stop_token& token = stop_token())
+{
+    static_assert(std::is_trivially_copyable<T>::value, "external sort reads and writes records as raw bytes");
+
+    external_sort_stats stats;
+    external_sort_temp_files temps(options.tempDirectory);
+
+    auto input = OpenForReading(inputPath);
+    input.seekg(0, std::ios::end);
+    const auto fileSize = static_cast<std::size_t>(input.tellg());
+    input.seekg(0);
+    if (fileSize % sizeof(T) != 0)
+    {
+        throw std::runtime_error(inputPath + " is not a whole number of records");
+    }
+    stats.numRecords = fileSize / sizeof(T);
+
+    const auto runLength = std::max<std::size_t>(options.memoryBudget / (2 * sizeof(T)), 1);
+    stats.numRuns = std::max<std::size_t>((stats.numRecords + runLength - 1) / runLength, 1);
+
+    std::vector<std::string> runs;
+    {
+        std::vector<T> reading(std::min(runLength, stats.numRecords));
+        std::vector<T> sorting(reading.size());
+
+        // declared after the buffers so an exception waits for the read before they go
+        auto pending = std::async(std::launch::async, [&] { return ReadRecords(input, reading.data(), reading.size()); });
+        for (auto run = std::size_t(0); run < stats.numRuns; ++run)
+        {
+            const auto count = pending.get();
+            std::swap(reading, sorting);
+            if (run + 1 < stats.numRuns)
+            {
+                pending = std::async(std::launch::async, [&] { return ReadRecords(input, reading.data(), reading.size()); });
+            }
+
+            parallel_quicksort(pool, sorting.begin(), sorting.begin() + count, comp, token);
+
+            // a single run is the result already
+            const auto path = (stats.numRuns == 1) ? outputPath : temps.Create(0, run);
+            auto file = OpenForWriting(path);
+            WriteRecords(file, sorting.data(), count);
+            file.close();
+            if (!file)
+            {
+                throw std::runtime_error("write error");
+            }
+            runs.push_back(path);
+        }
+    }
+
+    // every run being merged and the output get two blocks each
+    const auto maxFanIn = std::max<std::size_t>(options.memoryBudget / (2 * ExternalSortMinBlockSize), 3) - 1;
+    while (runs.size() > 1)
+    {
+        ++stats.numMergePasses;
+        const auto numGroups = (runs.size() + maxFanIn - 1) / maxFanIn;
+
+        std::vector<std::string> merged;
+        for (auto group = 0u; group < numGroups; ++group)
+        {
+            const auto bounds = SlabBounds(std::size_t(0), runs.size(), group, static_cast<unsigned int>(numGroups));
+            const std::vector<std::string> inputs(runs.begin() + bounds.first, runs.begin() + bounds.second);
+            const auto path = (numGroups == 1) ? outputPath : temps.Create(stats.numMergePasses, group);
+            const auto blockLength = std::max<std::size_t>(
+                options.memoryBudget / (2 * (inputs.size() + 1) * sizeof(T)), 1);
+
+            MergeRunFiles<T>(inputs, path, comp, blockLength, token);
+            for (const auto& run : inputs)
+            {
+                temps.Remove(run);
+            }
+            merged.push_back(path);
+        }
+        runs.swap(merged);
+    }
+
+    return stats;
+}
+
+template <typename T, typename Compare>
+external_sort_stats external_sort(const std::string& inputPath, const std::string& outputPath, Compare comp,
+    const external_sort_options& options = external_sort_options(), const stop_token& token = stop_token())
+{
+    return external_sort<T>(thread_pool::Default(), inputPath, outputPath, comp, options, token);
+}
+
+template <typename T>
+external_sort_stats external_sort(const std::string& inputPath, const std::string& outputPath)
+{
+    return external_sort<T>(thread_pool::Default(), inputPath, outputPath, std::less<>());
+}
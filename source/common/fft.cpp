@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <stdexcept>
 
 #include "fft.h"
 
@@ -107,17 +108,17 @@ std::vector<std::complex<double>> FFT(const std::vector<std::complex<double>>& d
 
     if (twiddle.size() * 2 != N)
     {
-        throw std::exception("Invalid Twiddle Factors");
+        throw std::invalid_argument("Invalid Twiddle Factors");
     }
 
     if (bitRev.size() != N)
     {
-        throw std::exception("Invalid Bit Reversal Indices");
+        throw std::invalid_argument("Invalid Bit Reversal Indices");
     }
 
     if (data.size() < N)
     {
-        throw std::exception("data is not a power of 2");
+        throw std::invalid_argument("data is not a power of 2");
     }
 
     std::vector<std::complex<double>> d(data.size());
@@ -0,0 +1,871 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "crc32c.h"
+#include "file_copy.h"
+
+namespace
+{
+    // a step of the tuner has to gain at least this much to be kept
+    const double MinTuneGain = 1.05;
+
+    // bytes handed to copy_file_range or sendfile at once, the token is checked in between
+    const std::uint64_t KernelCopyStep = std::uint64_t(64) << 20;
+
+    // buffer of the copies that hash what they copy, small enough to stay in the cache between hashing and writing
+    const std::size_t ChecksumBufferSize = std::size_t(1) << 20;
+
+    enum class file_access
+    {
+        read,
+        write
+    };
+
+#if defined(_WIN32)
+    typedef unsigned long device_id;
+
+    [[noreturn]] void ThrowLastError(const std::string& what)
+    {
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+    }
+
+    class native_file
+    {
+    private:
+        HANDLE _handle;
+        std::string _path;
+
+    public:
+        native_file(const std::string& path, file_access access, unsigned int = 0) : _path(path)
+        {
+            _handle = (access == file_access::read)
+                ? CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)
+                : CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (_handle == INVALID_HANDLE_VALUE)
+            {
+                ThrowLastError("cannot open " + path);
+            }
+        }
+
+        ~native_file()
+        {
+            CloseHandle(_handle);
+        }
+
+        native_file(const native_file&) = delete;
+        native_file& operator=(const native_file&) = delete;
+
+        const std::string& Path() const
+        {
+            return _path;
+        }
+
+        std::uint64_t Size() const
+        {
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(_handle, &size))
+            {
+                ThrowLastError("cannot get the size of " + _path);
+            }
+            return static_cast<std::uint64_t>(size.QuadPart);
+        }
+
+        unsigned int Permissions() const
+        {
+            return 0;
+        }
+
+        device_id Device() const
+        {
+            BY_HANDLE_FILE_INFORMATION info;
+            return GetFileInformationByHandle(_handle, &info) ? info.dwVolumeSerialNumber : 0;
+        }
+
+        void Preallocate(std::uint64_t size) const
+        {
+            FILE_ALLOCATION_INFO allocation;
+            allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+            SetFileInformationByHandle(_handle, FileAllocationInfo, &allocation, sizeof(allocation)); // only a hint
+
+            FILE_END_OF_FILE_INFO end;
+            end.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+            if (!SetFileInformationByHandle(_handle, FileEndOfFileInfo, &end, sizeof(end)))
+            {
+                ThrowLastError("cannot resize " + _path);
+            }
+        }
+
+        // reads up to size bytes, fewer only at the end of the file
+        std::size_t ReadAt(void* buffer, std::size_t size, std::uint64_t offset) const
+        {
+            auto done = std::size_t(0);
+            while (done < size)
+            {
+                OVERLAPPED position = {};
+                position.Offset = static_cast<DWORD>(offset + done);
+                position.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+                const auto request = static_cast<DWORD>(std::min<std::size_t>(size - done, 1u << 30));
+                DWORD read = 0;
+                if (!ReadFile(_handle, static_cast<char*>(buffer) + done, request, &read, &position))
+                {
+                    if (GetLastError() == ERROR_HANDLE_EOF)
+                    {
+                        break;
+                    }
+                    ThrowLastError("cannot read " + _path);
+                }
+                if (read == 0)
+                {
+                    break;
+                }
+                done += read;
+            }
+            return done;
+        }
+
+        void WriteAt(const void* buffer, std::size_t size, std::uint64_t offset) const
+        {
+            auto done = std::size_t(0);
+            while (done < size)
+            {
+                OVERLAPPED position = {};
+                position.Offset = static_cast<DWORD>(offset + done);
+                position.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+                const auto request = static_cast<DWORD>(std::min<std::size_t>(size - done, 1u << 30));
+                DWORD written = 0;
+                if (!WriteFile(_handle, static_cast<const char*>(buffer) + done, request, &written, &position))
+                {
+                    ThrowLastError("cannot write " + _path);
+                }
+                done += written;
+            }
+        }
+
+        // no reflinks, copy_file_range or sendfile here, everything goes through buffers
+        bool CloneFrom(const native_file&) const
+        {
+            return false;
+        }
+
+        bool CopyRangeTo(const native_file&, std::uint64_t, std::uint64_t, std::uint64_t& copied) const
+        {
+            copied = 0;
+            return false;
+        }
+
+        bool SendTo(const native_file&, std::uint64_t, std::uint64_t, std::uint64_t& copied) const
+        {
+            copied = 0;
+            return false;
+        }
+    };
+#elif defined(__linux__)
+    typedef dev_t device_id;
+
+    [[noreturn]] void ThrowErrno(const std::string& what)
+    {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    class native_file
+    {
+    private:
+        int _fd;
+        std::string _path;
+
+        struct stat Stat() const
+        {
+            struct stat info;
+            if (fstat(_fd, &info) != 0)
+            {
+                ThrowErrno("cannot stat " + _path);
+            }
+            return info;
+        }
+
+    public:
+        native_file(const std::string& path, file_access access, unsigned int permissions = 0644) : _path(path)
+        {
+            _fd = (access == file_access::read)
+                ? open(path.c_str(), O_RDONLY | O_CLOEXEC)
+                : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, permissions);
+            if (_fd < 0)
+            {
+                ThrowErrno("cannot open " + path);
+            }
+            // exactly the source's permissions, not masked by the umask
+            if (access == file_access::write && fchmod(_fd, permissions) != 0)
+            {
+                const auto error = errno;
+                close(_fd);
+                throw std::system_error(error, std::generic_category(), "cannot set the permissions of " + path);
+            }
+        }
+
+        ~native_file()
+        {
+            close(_fd);
+        }
+
+        native_file(const native_file&) = delete;
+        native_file& operator=(const native_file&) = delete;
+
+        const std::string& Path() const
+        {
+            return _path;
+        }
+
+        std::uint64_t Size() const
+        {
+            return static_cast<std::uint64_t>(Stat().st_size);
+        }
+
+        unsigned int Permissions() const
+        {
+            return static_cast<unsigned int>(Stat().st_mode & 07777);
+        }
+
+        device_id Device() const
+        {
+            return Stat().st_dev;
+        }
+
+        void Preallocate(std::uint64_t size) const
+        {
+            // not every filesystem can allocate up front, a sparse file of the right size will do
+            if (fallocate(_fd, 0, 0, static_cast<off_t>(size)) != 0 && ftruncate(_fd, static_cast<off_t>(size)) != 0)
+            {
+                ThrowErrno("cannot resize " + _path);
+            }
+        }
+
+        // reads up to size bytes, fewer only at the end of the file
+        std::size_t ReadAt(void* buffer, std::size_t size, std::uint64_t offset) const
+        {
+            auto done = std::size_t(0);
+            while (done < size)
+            {
+                const auto read = pread(_fd, static_cast<char*>(buffer) + done, size - done, static_cast<off_t>(offset + done));
+                if (read < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    ThrowErrno("cannot read " + _path);
+                }
+                if (read == 0)
+                {
+                    break;
+                }
+                done += static_cast<std::size_t>(read);
+            }
+            return done;
+        }
+
+        void WriteAt(const void* buffer, std::size_t size, std::uint64_t offset) const
+        {
+            auto done = std::size_t(0);
+            while (done < size)
+            {
+                const auto written = pwrite(_fd, static_cast<const char*>(buffer) + done, size - done, static_cast<off_t>(offset + done));
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    ThrowErrno("cannot write " + _path);
+                }
+                done += static_cast<std::size_t>(written);
+            }
+        }
+
+        /*
+        Makes this file share the extents of source (btrfs, XFS, ...), nothing
+        is copied until one of them is written to
+        */
+        bool CloneFrom(const native_file& source) const
+        {
+            return ioctl(_fd, FICLONE, source._fd) == 0;
+        }
+
+        /*
+        Copies [offset, offset + length) to the same offset of out inside the
+        kernel. Returns false if this pair of files cannot be copied that way;
+        copied tells how much was done either way, less than length only at
+        the end of the file.
+        */
+        bool CopyRangeTo(const native_file& out, std::uint64_t offset, std::uint64_t length, std::uint64_t& copied) const
+        {
+            copied = 0;
+            while (copied < length)
+            {
+                auto from = static_cast<loff_t>(offset + copied);
+                auto to = from;
+                const auto result = copy_file_range(_fd, &from, out._fd, &to, static_cast<std::size_t>(length - copied), 0);
+                if (result < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (IsUnsupported(errno))
+                    {
+                        return false;
+                    }
+                    ThrowErrno("cannot copy " + _path);
+                }
+                if (result == 0)
+                {
+                    // some filesystems report 0 instead of an error for what they cannot copy
+                    return copied > 0 || offset + length > Size();
+                }
+                copied += static_cast<std::uint64_t>(result);
+            }
+            return true;
+        }
+
+        /*
+        Same as CopyRangeTo with sendfile, which writes at the file position of
+        out, so only one thread may send to out at a time
+        */
+        bool SendTo(const native_file& out, std::uint64_t offset, std::uint64_t length, std::uint64_t& copied) const
+        {
+            copied = 0;
+            if (lseek(out._fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+            {
+                ThrowErrno("cannot seek in " + out._path);
+            }
+            while (copied < length)
+            {
+                auto from = static_cast<off_t>(offset + copied);
+                const auto result = sendfile(out._fd, _fd, &from, static_cast<std::size_t>(length - copied));
+                if (result < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (IsUnsupported(errno))
+                    {
+                        return false;
+                    }
+                    ThrowErrno("cannot copy " + _path);
+                }
+                if (result == 0)
+                {
+                    break;
+                }
+                copied += static_cast<std::uint64_t>(result);
+            }
+            return true;
+        }
+
+    private:
+        static bool IsUnsupported(int error)
+        {
+            return error == ENOSYS || error == EXDEV || error == EOPNOTSUPP || error == EINVAL;
+        }
+    };
+#endif
+
+    struct copy_settings
+    {
+        std::size_t chunkSize;
+        unsigned int workers;
+    };
+
+    /*
+    Hill climbing over the chunk size first, then the number of workers
+    */
+    class copy_tuner
+    {
+    private:
+        enum class phase
+        {
+            chunk_size,
+            workers,
+            settled
+        };
+
+        copy_settings _current;
+        copy_settings _best;
+        double _bestThroughput;
+        phase _phase;
+        std::size_t _maxChunkSize;
+        unsigned int _maxWorkers;
+
+        void TryMoreWorkers()
+        {
+            _phase = phase::workers;
+            if (_current.workers < _maxWorkers)
+            {
+                ++_current.workers;
+            }
+            else
+            {
+                _phase = phase::settled;
+            }
+        }
+
+    public:
+        copy_tuner(copy_settings start, std::size_t maxChunkSize, unsigned int maxWorkers) :
+            _current(start), _best(start), _bestThroughput(0.0), _phase(phase::chunk_size),
+            _maxChunkSize(maxChunkSize), _maxWorkers(maxWorkers) {}
+
+        const copy_settings& Current() const
+        {
+            return _current;
+        }
+
+        const copy_settings& Best() const
+        {
+            return _best;
+        }
+
+        void Measure(double throughput)
+        {
+            if (_phase == phase::settled)
+            {
+                return;
+            }
+
+            if (throughput > _bestThroughput * MinTuneGain)
+            {
+                _bestThroughput = throughput;
+                _best = _current;
+                if (_phase == phase::chunk_size && _current.chunkSize * 2 <= _maxChunkSize)
+                {
+                    _current.chunkSize *= 2;
+                }
+                else
+                {
+                    TryMoreWorkers();
+                }
+            }
+            else
+            {
+                _current = _best;
+                if (_phase == phase::chunk_size)
+                {
+                    TryMoreWorkers();
+                }
+                else
+                {
+                    _phase = phase::settled;
+                }
+            }
+        }
+    };
+
+    /*
+    Settled settings of earlier copies, per destination device
+    */
+    struct device_settings
+    {
+        std::mutex mutex;
+        std::map<device_id, copy_settings> settings;
+    };
+
+    device_settings& DeviceSettings()
+    {
+        static device_settings cache;
+        return cache;
+    }
+
+    [[noreturn]] void ThrowTruncated(const native_file& file)
+    {
+        throw std::runtime_error(file.Path() + " was truncated while being copied");
+    }
+
+    void CopyBuffered(const native_file& in, const native_file& out, std::uint64_t offset, std::uint64_t size,
+        std::size_t bufferSize, const stop_token& token)
+    {
+        std::vector<char> buffer(static_cast<std::size_t>(std::min<std::uint64_t>(bufferSize, size - offset)));
+        for (; offset < size; offset += buffer.size())
+        {
+            token.ThrowIfStopRequested();
+            const auto length = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), size - offset));
+            if (in.ReadAt(buffer.data(), length, offset) != length)
+            {
+                ThrowTruncated(in);
+            }
+            out.WriteAt(buffer.data(), length, offset);
+        }
+    }
+
+    /*
+    copy_file_range, then sendfile, then buffers, each one continuing where
+    the previous one gave up. Returns the method that copied the last byte,
+    buffered for an empty file, which none of them has to copy.
+    */
+    copy_method CopySerial(const native_file& in, const native_file& out, std::uint64_t size, std::size_t bufferSize,
+        const stop_token& token)
+    {
+        if (size == 0)
+        {
+            return copy_method::buffered;
+        }
+
+        auto offset = std::uint64_t(0);
+        auto inKernel = [&](copy_method method)
+        {
+            while (offset < size)
+            {
+                token.ThrowIfStopRequested();
+                const auto length = std::min(KernelCopyStep, size - offset);
+                auto copied = std::uint64_t(0);
+                const auto supported = (method == copy_method::copy_file_range)
+                    ? in.CopyRangeTo(out, offset, length, copied)
+                    : in.SendTo(out, offset, length, copied);
+                offset += copied;
+                if (!supported)
+                {
+                    return false;
+                }
+                if (copied < length)
+                {
+                    ThrowTruncated(in);
+                }
+            }
+            return true;
+        };
+
+        if (inKernel(copy_method::copy_file_range))
+        {
+            return copy_method::copy_file_range;
+        }
+        if (inKernel(copy_method::sendfile))
+        {
+            return copy_method::sendfile;
+        }
+        CopyBuffered(in, out, offset, size, bufferSize, token);
+        return copy_method::buffered;
+    }
+
+    /*
+    State shared by the workers of one chunked copy
+    */
+    struct chunk_copy
+    {
+        thread_pool& pool;
+        const native_file& source;
+        const native_file& destination;
+        const std::uint64_t size;
+        const stop_token& token;
+
+        std::mutex mutex;
+        copy_tuner tuner;
+        std::uint64_t nextOffset = 0;
+        unsigned int running = 1; // the calling thread
+        std::chrono::steady_clock::time_point windowStart = std::chrono::steady_clock::now();
+        std::uint64_t windowBytes = 0;
+        std::deque<std::future<void>> helpers; // references stay valid while it grows
+        std::exception_ptr error;
+        std::atomic<bool> inKernel{ true }; // until copy_file_range turns out not to work
+
+        chunk_copy(thread_pool& pool_, const native_file& source_, const native_file& destination_, std::uint64_t size_,
+            const stop_token& token_, const copy_tuner& tuner_) :
+            pool(pool_), source(source_), destination(destination_), size(size_), token(token_), tuner(tuner_) {}
+    };
+
+    void CopyChunks(chunk_copy& job);
+
+    // the caller holds job.mutex
+    void StartHelpers(chunk_copy& job)
+    {
+        while (job.running < job.tuner.Current().workers)
+        {
+            ++job.running;
+            job.helpers.push_back(job.pool.Submit([&job] { CopyChunks(job); }));
+        }
+    }
+
+    void ChunkDone(chunk_copy& job, std::size_t length)
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.windowBytes += length;
+        const auto now = std::chrono::steady_clock::now();
+        const auto elapsed = std::chrono::duration<double>(now - job.windowStart).count();
+        if (elapsed * 1000.0 >= FileCopyTuneInterval)
+        {
+            job.tuner.Measure(job.windowBytes / elapsed);
+            job.windowStart = now;
+            job.windowBytes = 0;
+            StartHelpers(job);
+        }
+    }
+
+    void CopyChunk(chunk_copy& job, std::vector<char>& buffer, std::uint64_t offset, std::size_t length)
+    {
+        if (job.inKernel)
+        {
+            auto copied = std::uint64_t(0);
+            const auto supported = job.source.CopyRangeTo(job.destination, offset, length, copied);
+            if (supported && copied < length)
+            {
+                ThrowTruncated(job.source);
+            }
+            if (supported)
+            {
+                return;
+            }
+            job.inKernel = false;
+            offset += copied;
+            length -= static_cast<std::size_t>(copied);
+        }
+
+        if (buffer.size() < length)
+        {
+            buffer.resize(length);
+        }
+        if (job.source.ReadAt(buffer.data(), length, offset) != length)
+        {
+            ThrowTruncated(job.source);
+        }
+        job.destination.WriteAt(buffer.data(), length, offset);
+    }
+
+    /*
+    Claims and copies chunks until none are left, a worker too many retires
+    */
+    void CopyChunks(chunk_copy& job)
+    {
+        std::vector<char> buffer;
+        for (;;)
+        {
+            std::uint64_t offset;
+            std::size_t length;
+            {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (job.error || job.token.StopRequested() || job.nextOffset >= job.size
+                    || job.running > job.tuner.Current().workers)
+                {
+                    --job.running;
+                    return;
+                }
+                offset = job.nextOffset;
+                length = static_cast<std::size_t>(std::min<std::uint64_t>(job.tuner.Current().chunkSize, job.size - offset));
+                job.nextOffset += length;
+            }
+
+            try
+            {
+                CopyChunk(job, buffer, offset, length);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (!job.error)
+                {
+                    job.error = std::current_exception();
+                }
+                --job.running;
+                return;
+            }
+
+            ChunkDone(job, length);
+        }
+    }
+}
+
+const char* CopyMethodName(copy_method method)
+{
+    switch (method)
+    {
+    case copy_method::reflink:
+        return "reflink";
+    case copy_method::copy_file_range:
+        return "copy_file_range";
+    case copy_method::sendfile:
+        return "sendfile";
+    default:
+        return "buffered";
+    }
+}
+
+file_copy_result CopyFileChunked(thread_pool& pool, const std::string& source, const std::string& destination,
+    const file_copy_options& options, const stop_token& token)
+{
+    if (options.minChunkSize == 0 || options.minChunkSize > options.maxChunkSize)
+    {
+        throw std::invalid_argument("chunk sizes must satisfy 0 < minChunkSize <= maxChunkSize");
+    }
+
+    const native_file in(source, file_access::read);
+    const native_file out(destination, file_access::write, in.Permissions());
+    const auto size = in.Size();
+
+    file_copy_result result;
+    result.bytes = size;
+    result.workers = 1;
+    if (size > 0 && out.CloneFrom(in))
+    {
+        result.method = copy_method::reflink;
+        return result;
+    }
+    out.Preallocate(size);
+
+    const auto poolWorkers = pool.Size() + 1;
+    const auto maxWorkers = (options.maxWorkers == 0) ? poolWorkers : std::min(options.maxWorkers, poolWorkers);
+    if (size < FileCopyMinChunks * options.minChunkSize || maxWorkers == 1)
+    {
+        result.chunkSize = static_cast<std::size_t>(std::min<std::uint64_t>(options.maxChunkSize, size));
+        result.method = CopySerial(in, out, size, options.maxChunkSize, token);
+        return result;
+    }
+
+    // start where the last copy to this device settled
+    const auto device = out.Device();
+    copy_settings start{ options.minChunkSize, 1 };
+    {
+        auto& cache = DeviceSettings();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        const auto known = cache.settings.find(device);
+        if (known != cache.settings.end())
+        {
+            start.chunkSize = std::min(std::max(known->second.chunkSize, options.minChunkSize), options.maxChunkSize);
+            start.workers = std::min(known->second.workers, maxWorkers);
+        }
+    }
+
+    chunk_copy job(pool, in, out, size, token, copy_tuner(start, options.maxChunkSize, maxWorkers));
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        StartHelpers(job);
+    }
+    CopyChunks(job);
+
+    // workers may still start helpers until the last chunk is claimed
+    for (auto i = std::size_t(0); ; ++i)
+    {
+        std::future<void>* helper;
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (i == job.helpers.size())
+            {
+                break;
+            }
+            helper = &job.helpers[i];
+        }
+        pool.Wait(*helper);
+    }
+
+    if (job.error)
+    {
+        std::rethrow_exception(job.error);
+    }
+    if (job.nextOffset < size)
+    {
+        throw operation_cancelled();
+    }
+
+    const auto settled = job.tuner.Best();
+    {
+        auto& cache = DeviceSettings();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.settings[device] = settled;
+    }
+    result.chunkSize = settled.chunkSize;
+    result.workers = settled.workers;
+    result.method = job.inKernel ? copy_method::copy_file_range : copy_method::buffered;
+    return result;
+}
+
+file_copy_result CopyFileChunked(const std::string& source, const std::string& destination)
+{
+    return CopyFileChunked(thread_pool::Default(), source, destination);
+}
+
+file_copy_result CopyFileZeroCopy(const std::string& source, const std::string& destination, const stop_token& token)
+{
+    const native_file in(source, file_access::read);
+    const native_file out(destination, file_access::write, in.Permissions());
+    const auto size = in.Size();
+
+    file_copy_result result;
+    result.bytes = size;
+    result.workers = 1;
+    if (size > 0 && out.CloneFrom(in))
+    {
+        result.method = copy_method::reflink;
+        return result;
+    }
+
+    const file_copy_options defaults;
+    out.Preallocate(size);
+    result.chunkSize = static_cast<std::size_t>(std::min<std::uint64_t>(defaults.maxChunkSize, size));
+    result.method = CopySerial(in, out, size, defaults.maxChunkSize, token);
+    return result;
+}
+
+file_copy_result CopyFileWithChecksum(const std::string& source, const std::string& destination, const stop_token& token)
+{
+    const native_file in(source, file_access::read);
+    const native_file out(destination, file_access::write, in.Permissions());
+    const auto size = in.Size();
+    out.Preallocate(size);
+
+    file_copy_result result;
+    result.bytes = size;
+    result.workers = 1;
+    result.chunkSize = static_cast<std::size_t>(std::min<std::uint64_t>(ChecksumBufferSize, size));
+    result.method = copy_method::buffered;
+
+    std::vector<char> buffer(result.chunkSize);
+    for (auto offset = std::uint64_t(0); offset < size; offset += buffer.size())
+    {
+        token.ThrowIfStopRequested();
+        const auto length = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), size - offset));
+        if (in.ReadAt(buffer.data(), length, offset) != length)
+        {
+            ThrowTruncated(in);
+        }
+        result.checksum = Crc32c(result.checksum, buffer.data(), length);
+        out.WriteAt(buffer.data(), length, offset);
+    }
+    return result;
+}
+
+std::uint32_t FileChecksum(const std::string& path, const stop_token& token)
+{
+    const native_file in(path, file_access::read);
+    const auto size = in.Size();
+
+    auto checksum = std::uint32_t(0);
+    std::vector<char> buffer(static_cast<std::size_t>(std::min<std::uint64_t>(ChecksumBufferSize, size)));
+    for (auto offset = std::uint64_t(0); offset < size; offset += buffer.size())
+    {
+        token.ThrowIfStopRequested();
+        const auto length = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), size - offset));
+        if (in.ReadAt(buffer.data(), length, offset) != length)
+        {
+            ThrowTruncated(in);
+        }
+        checksum = Crc32c(checksum, buffer.data(), length);
+    }
+    return checksum;
+}
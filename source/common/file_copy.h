@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Copy of a single (large) file split into chunks that are copied concurrently
+
+The source is cut into chunkSize ranges that workers on the pool claim one at a
+time and copy with positional reads and writes (pread/pwrite, ReadFile/WriteFile
+with an offset), so one 50GB file is copied by as many threads as help. The
+destination is preallocated to its final size first (fallocate,
+FileAllocationInfo), which keeps its extents contiguous no matter in which
+order the chunks land.
+
+How many workers and how large chunks pay off depends on the device, so both
+are tuned while copying: every FileCopyTuneInterval the throughput of the last
+interval is compared with the best so far. The chunk size doubles from
+minChunkSize while that helps, then workers are added one at a time while that
+helps, and the last step that did not help is undone. The settled values are
+remembered per destination device and are where the next copy to it starts.
+
+Data is moved by the cheapest way the two files allow (copy_method):
+- reflink: on filesystems that share extents (btrfs, XFS) the destination is
+  made a clone of the source with the FICLONE ioctl, only metadata is written
+- copy_file_range: the kernel copies between the files, no bytes pass through
+  user space and filesystems that can (NFS, SMB, same-device XFS) copy on the
+  server or by reference
+- sendfile: kernel side too, but it writes at the destination's file position,
+  so it is only used by a single thread
+- buffered: positional reads and writes through a buffer, always works; an
+  empty file, which needs none of them, reports it too
+Each one is tried when the previous one is not supported for this pair of
+files. On Windows everything is buffered.
+*/
+
+enum class copy_method
+{
+    reflink,
+    copy_file_range,
+    sendfile,
+    buffered
+};
+
+/*
+Number of copy_method values, which count up from 0
+*/
+constexpr std::size_t CopyMethodCount = 4;
+
+const char* CopyMethodName(copy_method method);
+
+struct file_copy_options
+{
+    std::size_t minChunkSize = std::size_t(1) << 20;
+    std::size_t maxChunkSize = std::size_t(16) << 20;
+    unsigned int maxWorkers = 0; // 0: pool size + 1
+};
+
+struct file_copy_result
+{
+    std::uint64_t bytes = 0;
+    std::size_t chunkSize = 0;  // settled chunk size
+    unsigned int workers = 0;   // settled number of workers
+    copy_method method = copy_method::buffered;
+    std::uint32_t checksum = 0; // CRC32C of the data, only set by CopyFileWithChecksum
+};
+
+/*
+Files smaller than this many minChunkSize chunks are copied by the calling
+thread alone
+*/
+constexpr std::size_t FileCopyMinChunks = 4;
+
+/*
+Length of the measurement window the tuner compares, in milliseconds
+*/
+constexpr unsigned int FileCopyTuneInterval = 250;
+
+/*
+Copies source to destination (created or truncated, with the source's
+permissions): a reflink if possible, otherwise chunks copied by
+copy_file_range or through buffers. Throws std::system_error when a file
+cannot be opened, read or written and operation_cancelled when the token is
+stopped; the destination is left incomplete then.
+*/
+file_copy_result CopyFileChunked(thread_pool& pool, const std::string& source, const std::string& destination,
+    const file_copy_options& options = file_copy_options(), const stop_token& token = stop_token());
+
+file_copy_result CopyFileChunked(const std::string& source, const std::string& destination);
+
+/*
+Single-threaded copy trying reflink, copy_file_range, sendfile and buffers in
+that order, result.method tells which one copied the file
+*/
+file_copy_result CopyFileZeroCopy(const std::string& source, const std::string& destination,
+    const stop_token& token = stop_token());
+
+/*
+Single-threaded buffered copy that computes the CRC32C (crc32c.h) of every
+buffer between reading and writing it, so the checksum of what was written
+costs no second pass over either file. The data passes through user space,
+none of the kernel side methods can be used.
+*/
+file_copy_result CopyFileWithChecksum(const std::string& source, const std::string& destination,
+    const stop_token& token = stop_token());
+
+/*
+CRC32C of the file's contents
+*/
+std::uint32_t FileChecksum(const std::string& path, const stop_token& token = stop_token());
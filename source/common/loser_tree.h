@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/*
+Tournament tree of losers for k-way merging
+
+Sources are numbered 0..k-1 and less(a, b) says whether the current head of
+source a goes before the head of source b. Every internal node keeps the
+loser of the match played there and the overall winner sits on top, so once
+the winning source has advanced only the matches on its path to the root are
+replayed: ceil(log2 k) comparisons per element, where a binary heap needs up
+to twice that to sift down.
+
+less must be a strict total order over the sources: exhausted sources go
+after everything else, and ties are broken by source index, which also makes
+the merge stable.
+*/
+template <typename Less>
+class loser_tree
+{
+private:
+    std::size_t _numSources;
+    std::vector<std::size_t> _nodes; // [0] is the winner, [1, k) the losers, leaf i is node k + i
+    Less _less;
+
+public:
+    loser_tree(std::size_t numSources, Less less) : _numSources(numSources), _nodes(numSources > 0 ? numSources : 1, 0),
+        _less(std::move(less))
+    {
+        // play the whole tournament bottom up once, winners move up
+        std::vector<std::size_t> winners(2 * _numSources);
+        for (auto i = std::size_t(0); i < _numSources; ++i)
+        {
+            winners[_numSources + i] = i;
+        }
+        for (auto node = _numSources; node > 1; )
+        {
+            --node;
+            const auto left = winners[2 * node];
+            const auto right = winners[2 * node + 1];
+            const auto leftWins = !_less(right, left);
+            winners[node] = leftWins ? left : right;
+            _nodes[node] = leftWins ? right : left;
+        }
+        _nodes[0] = (_numSources > 1) ? winners[1] : 0;
+    }
+
+    /*
+    Source whose head goes next, only valid with at least one source
+    */
+    std::size_t Winner() const
+    {
+        return _nodes[0];
+    }
+
+    /*
+    Call after the winner's head has changed (advanced or run out)
+    */
+    void ReplayWinner()
+    {
+        auto winner = _nodes[0];
+        for (auto node = (_numSources + winner) / 2; node > 0; node /= 2)
+        {
+            if (_less(_nodes[node], winner))
+            {
+                std::swap(_nodes[node], winner);
+            }
+        }
+        _nodes[0] = winner;
+    }
+};
+
+/*
+Stable order of two non-empty source heads a and b with a single comparison:
+the lower index wins unless it is strictly greater
+*/
+template <typename T, typename Compare>
+bool LoserTreeHeadLess(std::size_t a, const T& headA, std::size_t b, const T& headB, Compare& comp)
+{
+    return (a < b) ? !comp(headB, headA) : comp(headA, headB);
+}
+
+/*
+Merges k sorted runs in a single pass, handing every element in order to
+sink(value). Runs are iterator ranges and are not copied, elements are moved
+out of them. Equal elements keep the order of their runs.
+*/
+template <typename ForwardIt, typename Sink, typename Compare>
+void LoserTreeMerge(std::vector<std::pair<ForwardIt, ForwardIt>> runs, Sink sink, Compare comp)
+{
+    if (runs.empty())
+    {
+        return;
+    }
+
+    auto less = [&](std::size_t a, std::size_t b)
+    {
+        if (runs[a].first == runs[a].second)
+        {
+            return false;
+        }
+        if (runs[b].first == runs[b].second)
+        {
+            return true;
+        }
+        return LoserTreeHeadLess(a, *runs[a].first, b, *runs[b].first, comp);
+    };
+
+    loser_tree<decltype(less)> tree(runs.size(), less);
+    while (true)
+    {
+        auto& run = runs[tree.Winner()];
+        if (run.first == run.second)
+        {
+            // the winner is only exhausted once all of them are
+            return;
+        }
+        sink(std::move(*run.first));
+        ++run.first;
+        tree.ReplayWinner();
+    }
+}
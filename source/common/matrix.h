@@ -2,43 +2,55 @@
 
 #include <algorithm>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
-#include <exception>
+#include <stdexcept>
 
-template <typename T>
+#include "parallel_for.h"
+#include "sharded_counter.h"
+
+/*
+Allocator is the storage's allocator, e.g. first_touch_allocator (numa.h) for
+storage whose elements are constructed by the threads that will use them.
+Every element the matrix creates itself is constructed explicitly, so an
+allocator that leaves value-initialization out works too.
+*/
+template <typename T, typename Allocator = std::allocator<T>>
 class matrix
 {
 private:
-    typedef typename std::vector<T>::size_type size_type;
-    std::vector<T> _data; // row-major
+    typedef std::vector<T, Allocator> storage_type;
+    typedef typename storage_type::size_type size_type;
+    storage_type _data; // row-major
     // (x, y) -> _data[y * _width + x]
     size_type _width; // num elements per row
     size_type _height; // num elements per col (height)
 
 public:
     matrix() : _data(), _width(), _height() {}
-    matrix(size_type width, size_type height) : _data(width * height), _width(width), _height(height) {}
-    matrix(size_type width, size_type height, const std::vector<T>& data) :
+    matrix(size_type width, size_type height) : _data(width * height, T()), _width(width), _height(height) {}
+    matrix(size_type width, size_type height, const storage_type& data) :
         _data(data), _width(width), _height(height)
     {
         if (_data.size() != _width * _height)
         {
-            throw std::exception("Mismatching dimensions");
+            throw std::invalid_argument("Mismatching dimensions");
         }
     }
-    matrix(size_type width, size_type height, std::vector<T>&& data) :
+    matrix(size_type width, size_type height, storage_type&& data) :
         _data(std::move(data)), _width(width), _height(height)
     {
         if (_data.size() != _width * _height)
         {
-            throw std::exception("Mismatching dimensions");
+            throw std::invalid_argument("Mismatching dimensions");
         }
     }
     
     void Resize(size_type cols, size_type rows)
     {
-        std::vector<T> newData(cols * rows);
+        storage_type newData(cols * rows, T());
         auto smallerRow = (rows < _height) ? rows : _height;
         auto smallerCol = (cols < _width) ? cols : _width;
         for (auto row = 0u; row < smallerRow; ++row)
@@ -56,7 +68,7 @@ public:
 
     std::vector<T> ToVector() const
     {
-        return _data;
+        return std::vector<T>(_data.begin(), _data.end());
     }
 
     T& At(size_type x, size_type y)
@@ -154,7 +166,15 @@ public:
         return _height;
     }
 
-    const std::vector<T>& Raw() const
+    /*
+    Row-major elements, e.g. to run std or parallel algorithms on the whole matrix
+    */
+    storage_type& Raw()
+    {
+        return _data;
+    }
+
+    const storage_type& Raw() const
     {
         return _data;
     }
@@ -179,7 +199,7 @@ public:
 
     void Normalize()
     {
-        T highest = std::numeric_limits<T>::min();
+        T highest = std::numeric_limits<T>::lowest();
         T lowest = std::numeric_limits<T>::max();
 
         std::for_each(_data.begin(), _data.end(), [&](const T& el)
@@ -204,4 +224,36 @@ public:
             return (el - lowest) / range;
         });
     }
+
+    /*
+    Normalize on the pool: each chunk finds its own bounds and folds them into
+    per-thread shards once, instead of every element hitting a shared atomic
+    */
+    void Normalize(thread_pool& pool)
+    {
+        sharded_min<T> lowest;
+        sharded_max<T> highest;
+
+        parallel_for(pool, size_type(0), _data.size(), [&](size_type first, size_type last)
+        {
+            const auto bounds = std::minmax_element(_data.cbegin() + first, _data.cbegin() + last);
+            lowest.Update(*bounds.first);
+            highest.Update(*bounds.second);
+        });
+
+        const T low = lowest.Value();
+        const T range = highest.Value() - low;
+        if (range <= std::numeric_limits<T>::epsilon())
+        {
+            return;
+        }
+
+        parallel_for(pool, size_type(0), _data.size(), [&](size_type first, size_type last)
+        {
+            std::transform(_data.begin() + first, _data.begin() + last, _data.begin() + first, [&](const T& el)
+            {
+                return (el - low) / range;
+            });
+        });
+    }
 };
@@ -0,0 +1,149 @@
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "node_pool.h"
+
+namespace
+{
+    const std::size_t NumSizeClasses = NodePoolMaxSize / NodePoolGranularity;
+    const std::size_t BlocksPerChunk = 4 * NodePoolBatchSize;
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    struct free_list
+    {
+        free_block* head = nullptr;
+        std::size_t count = 0;
+    };
+
+    struct depot
+    {
+        std::mutex mutex;
+        std::vector<free_list> batches;
+    };
+
+    // leaked on purpose: containers with static storage duration may still
+    // free nodes after everything else has been destroyed
+    depot& Depot(std::size_t sizeClass)
+    {
+        static depot* const depots = new depot[NumSizeClasses];
+        return depots[sizeClass];
+    }
+
+    std::size_t SizeClass(std::size_t size)
+    {
+        return (size == 0) ? 0 : (size - 1) / NodePoolGranularity;
+    }
+
+    void ReturnToDepot(std::size_t sizeClass, free_list list)
+    {
+        auto& d = Depot(sizeClass);
+        std::lock_guard<std::mutex> lock(d.mutex);
+        d.batches.push_back(list);
+    }
+
+    struct thread_cache
+    {
+        free_list lists[NumSizeClasses];
+
+        ~thread_cache()
+        {
+            for (auto sizeClass = std::size_t(0); sizeClass < NumSizeClasses; ++sizeClass)
+            {
+                if (lists[sizeClass].count > 0)
+                {
+                    ReturnToDepot(sizeClass, lists[sizeClass]);
+                    lists[sizeClass] = free_list();
+                }
+            }
+        }
+    };
+
+    thread_local thread_cache cache;
+
+    free_list Refill(std::size_t sizeClass)
+    {
+        {
+            auto& d = Depot(sizeClass);
+            std::lock_guard<std::mutex> lock(d.mutex);
+            if (!d.batches.empty())
+            {
+                const auto batch = d.batches.back();
+                d.batches.pop_back();
+                return batch;
+            }
+        }
+
+        // carve a new chunk into a list of blocks
+        const auto blockSize = (sizeClass + 1) * NodePoolGranularity;
+        auto chunk = static_cast<char*>(::operator new(blockSize * BlocksPerChunk));
+        free_list list;
+        for (auto i = BlocksPerChunk; i > 0; --i)
+        {
+            auto block = reinterpret_cast<free_block*>(chunk + (i - 1) * blockSize);
+            block->next = list.head;
+            list.head = block;
+        }
+        list.count = BlocksPerChunk;
+        return list;
+    }
+}
+
+void* NodePoolAllocate(std::size_t size)
+{
+    if (size > NodePoolMaxSize)
+    {
+        return ::operator new(size);
+    }
+
+    auto& list = cache.lists[SizeClass(size)];
+    if (list.head == nullptr)
+    {
+        list = Refill(SizeClass(size));
+    }
+
+    auto block = list.head;
+    list.head = block->next;
+    --list.count;
+    return block;
+}
+
+void NodePoolDeallocate(void* block, std::size_t size)
+{
+    if (block == nullptr)
+    {
+        return;
+    }
+    if (size > NodePoolMaxSize)
+    {
+        ::operator delete(block);
+        return;
+    }
+
+    auto& list = cache.lists[SizeClass(size)];
+    auto freed = static_cast<free_block*>(block);
+    freed->next = list.head;
+    list.head = freed;
+    ++list.count;
+
+    // more than two batches cached, the first one goes back to the depot
+    if (list.count >= 2 * NodePoolBatchSize)
+    {
+        free_list batch;
+        batch.head = list.head;
+        batch.count = NodePoolBatchSize;
+        auto last = list.head;
+        for (auto i = std::size_t(1); i < NodePoolBatchSize; ++i)
+        {
+            last = last->next;
+        }
+        list.head = last->next;
+        list.count -= NodePoolBatchSize;
+        last->next = nullptr;
+        ReturnToDepot(SizeClass(size), batch);
+    }
+}
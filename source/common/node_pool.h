@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <new>
+
+/*
+Pool allocator for node-based containers
+
+Node containers allocate and free one small block per element, and when
+elements are created on one thread and destroyed on another every operation
+goes through the global heap. Here blocks of the same size class are
+interchangeable and recycled:
+- every thread keeps its own free list per size class, allocating and
+  freeing is a push or pop without any locking
+- a thread that frees more than it allocates (nodes made elsewhere) hands
+  NodePoolBatchSize blocks at a time to a global depot, and a thread that
+  runs dry takes a whole batch back, one lock per batch instead of per node
+- only when the depot is empty is a new chunk carved up
+- a thread's free lists go back to the depot when it exits
+
+Memory is never returned to the system, the pool is sized by the peak.
+Requests larger than NodePoolMaxSize, or aligned more strictly than the
+default new alignment, go to operator new.
+*/
+
+constexpr std::size_t NodePoolGranularity = 16;
+constexpr std::size_t NodePoolMaxSize = 256;
+constexpr std::size_t NodePoolBatchSize = 64;
+
+void* NodePoolAllocate(std::size_t size);
+void NodePoolDeallocate(void* block, std::size_t size);
+
+/*
+Stateless std allocator on top of the node pool. All instances compare equal,
+so nodes can be spliced between containers and freed by any thread.
+*/
+template <typename T>
+class node_pool_allocator
+{
+private:
+    static constexpr bool Pooled = sizeof(T) <= NodePoolMaxSize && alignof(T) <= NodePoolGranularity;
+
+public:
+    typedef T value_type;
+
+    node_pool_allocator() noexcept = default;
+
+    template <typename U>
+    node_pool_allocator(const node_pool_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        if (Pooled && n == 1)
+        {
+            return static_cast<T*>(NodePoolAllocate(sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (Pooled && n == 1)
+        {
+            NodePoolDeallocate(p, sizeof(T));
+            return;
+        }
+        ::operator delete(p);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const node_pool_allocator<T>&, const node_pool_allocator<U>&) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const node_pool_allocator<T>&, const node_pool_allocator<U>&) noexcept
+{
+    return false;
+}
+
+template <typename T>
+using pool_list = std::list<T, node_pool_allocator<T>>;
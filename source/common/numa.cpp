@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "numa.h"
+
+std::vector<unsigned int> ParseCpuList(const std::string& list)
+{
+    std::vector<unsigned int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ','))
+    {
+        const auto dash = range.find('-');
+        try
+        {
+            const auto first = static_cast<unsigned int>(std::stoul(range.substr(0, dash)));
+            const auto last = (dash == std::string::npos) ? first : static_cast<unsigned int>(std::stoul(range.substr(dash + 1)));
+            for (auto cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (const std::exception&)
+        {
+            // empty or malformed entry (e.g. trailing newline), skip it
+        }
+    }
+    return cpus;
+}
+
+namespace
+{
+#if defined(__linux__)
+    std::string ReadFirstLine(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    std::vector<numa_node> DiscoverNodes()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        const auto haveMask = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+        std::vector<numa_node> nodes;
+        for (auto id : ParseCpuList(ReadFirstLine("/sys/devices/system/node/online")))
+        {
+            numa_node node{ id, {} };
+            const auto path = "/sys/devices/system/node/node" + std::to_string(id) + "/cpulist";
+            for (auto cpu : ParseCpuList(ReadFirstLine(path)))
+            {
+                if (!haveMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                {
+                    node.cpus.push_back(cpu);
+                }
+            }
+
+            // memory-only nodes have nothing to run workers on
+            if (!node.cpus.empty())
+            {
+                nodes.push_back(std::move(node));
+            }
+        }
+        return nodes;
+    }
+#elif defined(_WIN32)
+    std::vector<numa_node> DiscoverNodes()
+    {
+        // processor group 0 only, that is the first 64 logical processors
+        std::vector<numa_node> nodes;
+        ULONG highestNode = 0;
+        if (!GetNumaHighestNodeNumber(&highestNode))
+        {
+            return nodes;
+        }
+
+        for (auto id = 0ul; id <= highestNode; ++id)
+        {
+            ULONGLONG mask = 0;
+            if (!GetNumaNodeProcessorMask(static_cast<UCHAR>(id), &mask) || mask == 0)
+            {
+                continue;
+            }
+
+            numa_node node{ static_cast<unsigned int>(id), {} };
+            for (auto cpu = 0u; cpu < 64; ++cpu)
+            {
+                if (mask & (1ull << cpu))
+                {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            nodes.push_back(std::move(node));
+        }
+        return nodes;
+    }
+#else
+    std::vector<numa_node> DiscoverNodes()
+    {
+        return std::vector<numa_node>();
+    }
+#endif
+}
+
+numa_topology numa_topology::Discover()
+{
+    numa_topology topology;
+    topology._nodes = DiscoverNodes();
+
+    if (topology._nodes.empty())
+    {
+        numa_node node{ 0, {} };
+        const auto numCpus = std::max(std::thread::hardware_concurrency(), 1u);
+        for (auto cpu = 0u; cpu < numCpus; ++cpu)
+        {
+            node.cpus.push_back(cpu);
+        }
+        topology._nodes.push_back(std::move(node));
+    }
+
+    return topology;
+}
+
+std::vector<unsigned int> numa_topology::Cpus() const
+{
+    std::vector<unsigned int> cpus;
+    for (const auto& node : _nodes)
+    {
+        cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+    }
+    return cpus;
+}
+
+unsigned int numa_topology::NodeOfCpu(unsigned int cpu) const
+{
+    for (auto i = 0u; i < _nodes.size(); ++i)
+    {
+        const auto& cpus = _nodes[i].cpus;
+        if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end())
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+bool PinCurrentThreadToCpu(unsigned int cpu)
+{
+#if defined(__linux__)
+    if (cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    if (cpu >= 64)
+    {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1ull << cpu)) != 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+std::size_t GetPageSize()
+{
+#if defined(__linux__)
+    const auto pageSize = sysconf(_SC_PAGESIZE);
+    return (pageSize > 0) ? static_cast<std::size_t>(pageSize) : 4096;
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return 4096;
+#endif
+}
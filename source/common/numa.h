@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.h"
+#include "thread_pool.h"
+
+struct numa_node
+{
+    unsigned int id; // as numbered by the OS
+    std::vector<unsigned int> cpus;
+};
+
+/*
+NUMA nodes and the CPUs on each of them
+
+On Linux this is read from /sys/devices/system/node and restricted to the CPUs
+the process is allowed to run on. Machines (or OSes) without NUMA information
+show up as a single node holding every CPU.
+*/
+class numa_topology
+{
+private:
+    std::vector<numa_node> _nodes;
+
+public:
+    static numa_topology Discover();
+
+    const std::vector<numa_node>& Nodes() const
+    {
+        return _nodes;
+    }
+
+    /*
+    Every CPU, listed node by node
+    */
+    std::vector<unsigned int> Cpus() const;
+
+    /*
+    Index into Nodes() of the node the CPU belongs to
+    */
+    unsigned int NodeOfCpu(unsigned int cpu) const;
+};
+
+/*
+Parse the kernel's CPU list format, e.g. "0-3,8,10-11"
+*/
+std::vector<unsigned int> ParseCpuList(const std::string& list);
+
+/*
+Returns false if the OS refused or does not support it
+*/
+bool PinCurrentThreadToCpu(unsigned int cpu);
+
+std::size_t GetPageSize();
+
+/*
+Allocator that leaves value-initialization to its user: vector(n) and
+resize(n) only allocate, the new elements are raw storage until constructed
+with placement new. Copies and every other construction behave as usual.
+The vector destroys its elements whether they were constructed or not, so only
+trivially destructible types are allowed.
+*/
+template <typename T>
+class first_touch_allocator
+{
+    static_assert(std::is_trivially_destructible<T>::value, "first_touch_allocator needs a trivially destructible T");
+
+public:
+    typedef T value_type;
+
+    first_touch_allocator() = default;
+
+    template <typename U>
+    first_touch_allocator(const first_touch_allocator<U>&) {}
+
+    T* allocate(std::size_t n)
+    {
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    void construct(U*)
+    {
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const first_touch_allocator<T>&, const first_touch_allocator<U>&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const first_touch_allocator<T>&, const first_touch_allocator<U>&)
+{
+    return false;
+}
+
+template <typename T>
+using first_touch_vector = std::vector<T, first_touch_allocator<T>>;
+
+/*
+Allocate rows * rowLength value-initialized elements such that the elements of
+the i-th slab of rows (see SlabBounds) are constructed, and so their pages
+first touched, by worker i of the pool.
+
+The OS places a page on the node of the thread that first writes to it, so
+with a pinned pool and parallel_for_static over the same rows every worker
+processes memory local to its node.
+*/
+template <typename T>
+first_touch_vector<T> MakeFirstTouchVector(thread_pool& pool, std::size_t rows, std::size_t rowLength)
+{
+    // storage only, nothing is written yet
+    first_touch_vector<T> data(rows * rowLength);
+
+    auto construct = [&](std::size_t first, std::size_t last)
+    {
+        for (auto i = first; i < last; ++i)
+        {
+            ::new (static_cast<void*>(data.data() + i)) T();
+        }
+    };
+    if (pool.Size() == 0)
+    {
+        construct(0, data.size());
+        return data;
+    }
+
+    pool.RunOnEachWorker([&](unsigned int worker)
+    {
+        const auto slab = SlabBounds<std::size_t>(0, rows, worker, pool.Size());
+        construct(slab.first * rowLength, slab.second * rowLength);
+    });
+    return data;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+[begin, end) of the part-th of numParts nearly equal slabs of [first, last)
+*/
+template <typename Index>
+std::pair<Index, Index> SlabBounds(Index first, Index last, unsigned int part, unsigned int numParts)
+{
+    const auto count = static_cast<unsigned long long>(last - first);
+    const auto begin = first + static_cast<Index>(count * part / numParts);
+    const auto end = first + static_cast<Index>(count * (part + 1) / numParts);
+    return std::make_pair(begin, end);
+}
+
+/*
+Split [first, last) into chunks and call body(chunkFirst, chunkLast) for each
+of them on the pool. The calling thread takes chunks too.
+
+Chunks are claimed one at a time so uneven chunks balance out. The token is
+checked before each chunk: once a stop is requested no new chunk starts and
+operation_cancelled is thrown as soon as the running chunks return.
+The first exception thrown by body is rethrown.
+*/
+template <typename Index, typename Body>
+void parallel_for(thread_pool& pool, Index first, Index last, Index grainSize, const Body& body,
+    const stop_token& token = stop_token())
+{
+    static_assert(std::is_integral<Index>::value, "parallel_for needs an integral index");
+
+    if (!(first < last))
+    {
+        return;
+    }
+
+    if (grainSize < 1)
+    {
+        grainSize = 1;
+    }
+    const Index numChunks = (last - first + grainSize - 1) / grainSize;
+
+    std::atomic<Index> nextChunk(0);
+    std::atomic<Index> completedChunks(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto runChunks = [&]
+    {
+        while (!failed && !token.StopRequested())
+        {
+            const Index chunk = nextChunk++;
+            if (!(chunk < numChunks))
+            {
+                return;
+            }
+
+            const Index chunkFirst = first + chunk * grainSize;
+            const Index chunkLast = (chunk == numChunks - 1) ? last : chunkFirst + grainSize;
+            try
+            {
+                body(chunkFirst, chunkLast);
+                ++completedChunks;
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+
+    // the helpers reference this stack frame, every one of them is waited on
+    const auto numHelpers = std::min(static_cast<std::size_t>(numChunks - 1), static_cast<std::size_t>(pool.Size()));
+    std::vector<std::future<void>> helpers;
+    helpers.reserve(numHelpers);
+    for (auto i = 0u; i < numHelpers; ++i)
+    {
+        helpers.push_back(pool.Submit(runChunks));
+    }
+
+    runChunks();
+
+    for (auto& helper : helpers)
+    {
+        pool.Wait(helper);
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    if (completedChunks != numChunks)
+    {
+        throw operation_cancelled();
+    }
+}
+
+/*
+Chunk size picked so every thread gets about 4 chunks
+*/
+template <typename Index, typename Body>
+void parallel_for(thread_pool& pool, Index first, Index last, const Body& body,
+    const stop_token& token = stop_token())
+{
+    if (!(first < last))
+    {
+        return;
+    }
+    const Index grainSize = static_cast<Index>((last - first) / (4 * (pool.Size() + 1)));
+    parallel_for(pool, first, last, grainSize, body, token);
+}
+
+template <typename Index, typename Body>
+void parallel_for(Index first, Index last, const Body& body, const stop_token& token = stop_token())
+{
+    parallel_for(thread_pool::Default(), first, last, body, token);
+}
+
+/*
+Static schedule: worker i of the pool always gets the i-th slab of [first, last)
+(see SlabBounds), handed to body in grainSize pieces with a token check before
+each piece.
+
+Use this instead of parallel_for when the same rows are touched in several
+passes, with a pinned pool and first-touch allocation (numa.h) every worker
+then only touches memory on its own node.
+*/
+template <typename Index, typename Body>
+void parallel_for_static(thread_pool& pool, Index first, Index last, Index grainSize, const Body& body,
+    const stop_token& token = stop_token())
+{
+    static_assert(std::is_integral<Index>::value, "parallel_for_static needs an integral index");
+
+    if (!(first < last))
+    {
+        return;
+    }
+
+    if (grainSize < 1)
+    {
+        grainSize = 1;
+    }
+
+    std::atomic<bool> cancelled(false);
+    pool.RunOnEachWorker([&](unsigned int worker)
+    {
+        const auto slab = SlabBounds(first, last, worker, pool.Size());
+        for (auto chunkFirst = slab.first; chunkFirst < slab.second; chunkFirst += grainSize)
+        {
+            if (token.StopRequested())
+            {
+                cancelled = true;
+                return;
+            }
+            const Index chunkLast = (slab.second - chunkFirst > grainSize) ? chunkFirst + grainSize : slab.second;
+            body(chunkFirst, chunkLast);
+        }
+    });
+
+    if (cancelled)
+    {
+        throw operation_cancelled();
+    }
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "loser_tree.h"
+#include "parallel_for.h"
+#include "simd_sort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Multiway merge of sorted runs
+
+Ties are broken by run index and then by position, so equal elements keep
+the order of the runs they came from and the merge is stable.
+*/
+
+/*
+Co-rank of a multiway merge: how many elements of each run end up in the
+first rank elements of the merged output
+
+Selects the rank-th element under the (value, run, position) order by
+narrowing a window [lo, hi) in every run. Each step takes the middle of the
+widest window as the pivot and counts what lies before it in every run, so
+the widest window at least halves: O(k log n) steps of O(k log n) each.
+*/
+template <typename RandomIt, typename Compare>
+std::vector<std::size_t> MultiwayCoRank(const std::vector<std::pair<RandomIt, RandomIt>>& runs, std::size_t rank, Compare comp)
+{
+    const auto k = runs.size();
+    std::vector<std::size_t> lo(k, 0);
+    std::vector<std::size_t> hi(k);
+    std::vector<std::size_t> before(k);
+
+    auto total = std::size_t(0);
+    for (auto i = 0u; i < k; ++i)
+    {
+        hi[i] = static_cast<std::size_t>(runs[i].second - runs[i].first);
+        total += hi[i];
+    }
+    if (rank >= total)
+    {
+        return hi;
+    }
+
+    while (true)
+    {
+        auto widest = k;
+        auto widestSize = std::size_t(0);
+        for (auto i = 0u; i < k; ++i)
+        {
+            if (hi[i] - lo[i] > widestSize)
+            {
+                widest = i;
+                widestSize = hi[i] - lo[i];
+            }
+        }
+        if (widest == k)
+        {
+            // every window is empty, lo sums up to rank
+            return lo;
+        }
+
+        const auto pivotIndex = lo[widest] + widestSize / 2;
+        const auto& pivot = *(runs[widest].first + pivotIndex);
+
+        // everything before lo[i] is already known to be before the pivot and
+        // everything from hi[i] on after it, only the windows need searching
+        auto numBefore = std::size_t(0);
+        for (auto i = 0u; i < k; ++i)
+        {
+            const auto first = runs[i].first + lo[i];
+            const auto last = runs[i].first + hi[i];
+            if (i < widest)
+            {
+                // earlier runs win ties
+                before[i] = lo[i] + (std::upper_bound(first, last, pivot, comp) - first);
+            }
+            else if (i > widest)
+            {
+                before[i] = lo[i] + (std::lower_bound(first, last, pivot, comp) - first);
+            }
+            else
+            {
+                before[i] = pivotIndex;
+            }
+            numBefore += before[i];
+        }
+
+        if (numBefore == rank)
+        {
+            return before;
+        }
+
+        if (numBefore < rank)
+        {
+            // the pivot and everything before it are in the prefix
+            lo = before;
+            ++lo[widest];
+        }
+        else
+        {
+            hi = before;
+        }
+    }
+}
+
+/*
+Single-threaded stable merge of k sorted runs into out, elements are moved out of the runs
+*/
+template <typename RandomIt, typename OutputIt, typename Compare>
+OutputIt MultiwayMerge(const std::vector<std::pair<RandomIt, RandomIt>>& runs, OutputIt out, Compare comp)
+{
+    std::vector<std::pair<RandomIt, RandomIt>> active;
+    active.reserve(runs.size());
+    for (const auto& run : runs)
+    {
+        if (run.first != run.second)
+        {
+            active.push_back(run);
+        }
+    }
+
+    if (active.empty())
+    {
+        return out;
+    }
+    if (active.size() == 1)
+    {
+        return std::move(active[0].first, active[0].second, out);
+    }
+    if (active.size() == 2)
+    {
+        if constexpr (IsSimdSortable<RandomIt, Compare>() && IsSimdSortable<OutputIt, Compare>())
+        {
+            const auto sizeA = static_cast<std::size_t>(active[0].second - active[0].first);
+            const auto sizeB = static_cast<std::size_t>(active[1].second - active[1].first);
+            SimdMerge(&*active[0].first, sizeA, &*active[1].first, sizeB, &*out);
+            return out + (sizeA + sizeB);
+        }
+        return std::merge(std::make_move_iterator(active[0].first), std::make_move_iterator(active[0].second),
+            std::make_move_iterator(active[1].first), std::make_move_iterator(active[1].second), out, comp);
+    }
+
+    LoserTreeMerge(active, [&out](auto&& value)
+    {
+        *out = std::move(value);
+        ++out;
+    }, comp);
+    return out;
+}
+
+/*
+Merge k sorted runs into the random access range starting at out, which must
+hold the sum of the run lengths and must not overlap the runs. Elements are
+moved out of the runs.
+
+The output is cut into one equal slice per thread. Where every slice starts
+in every run is found with MultiwayCoRank, then each slice merges its part
+on its own, so no thread waits on another and nothing is copied twice.
+*/
+template <typename RandomIt, typename OutputIt, typename Compare>
+void parallel_multiway_merge(thread_pool& pool, const std::vector<std::pair<RandomIt, RandomIt>>& runs, OutputIt out,
+    Compare comp, const stop_token& token = stop_token())
+{
+    auto total = std::size_t(0);
+    for (const auto& run : runs)
+    {
+        total += static_cast<std::size_t>(run.second - run.first);
+    }
+
+    const auto numSlices = std::min<std::size_t>(pool.Size() + 1, total);
+    if (numSlices == 0)
+    {
+        return;
+    }
+
+    // all splits are found before anything is moved, the searches read
+    // elements that other slices merge
+    std::vector<std::vector<std::size_t>> splits(numSlices + 1);
+    parallel_for(pool, std::size_t(0), numSlices + 1, std::size_t(1), [&](std::size_t first, std::size_t last)
+    {
+        for (auto slice = first; slice < last; ++slice)
+        {
+            const auto rank = SlabBounds(std::size_t(0), total, static_cast<unsigned int>(slice), static_cast<unsigned int>(numSlices)).first;
+            splits[slice] = MultiwayCoRank(runs, rank, comp);
+        }
+    }, token);
+
+    parallel_for(pool, std::size_t(0), numSlices, std::size_t(1), [&](std::size_t first, std::size_t last)
+    {
+        for (auto slice = first; slice < last; ++slice)
+        {
+            std::vector<std::pair<RandomIt, RandomIt>> parts(runs.size());
+            auto offset = std::size_t(0);
+            for (auto i = 0u; i < runs.size(); ++i)
+            {
+                parts[i] = std::make_pair(runs[i].first + splits[slice][i], runs[i].first + splits[slice + 1][i]);
+                offset += splits[slice][i];
+            }
+            MultiwayMerge(parts, out + offset, comp);
+        }
+    }, token);
+}
+
+template <typename RandomIt, typename OutputIt>
+void parallel_multiway_merge(thread_pool& pool, const std::vector<std::pair<RandomIt, RandomIt>>& runs, OutputIt out)
+{
+    parallel_multiway_merge(pool, runs, out, std::less<>());
+}
+
+template <typename RandomIt, typename OutputIt, typename Compare>
+void parallel_multiway_merge(const std::vector<std::pair<RandomIt, RandomIt>>& runs, OutputIt out,
+    Compare comp, const stop_token& token = stop_token())
+{
+    parallel_multiway_merge(thread_pool::Default(), runs, out, comp, token);
+}
+
+template <typename RandomIt, typename OutputIt>
+void parallel_multiway_merge(const std::vector<std::pair<RandomIt, RandomIt>>& runs, OutputIt out)
+{
+    parallel_multiway_merge(thread_pool::Default(), runs, out, std::less<>());
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Below this many elements the partition runs serially
+*/
+constexpr std::size_t ParallelPartitionCutoff = 1 << 16;
+
+/*
+Parallel in-place partition: moves the elements for which pred is true to
+the front of [first, last) and returns the partition point. Not stable.
+
+1. Every thread partitions its own block with std::partition
+2. The total count of true elements, t, says where the boundary will be:
+   false elements left of t and true elements right of it are misplaced, and
+   there are exactly as many of one as of the other
+3. The misplaced elements are paired up in order and swapped, every thread
+   taking an equal share of the pairs
+
+Both passes split the work evenly whatever the data, and the fix-up only
+touches misplaced elements.
+*/
+template <typename RandomIt, typename Predicate>
+RandomIt parallel_partition(thread_pool& pool, RandomIt first, RandomIt last, Predicate pred,
+    const stop_token& token = stop_token())
+{
+    typedef std::pair<std::size_t, std::size_t> interval;
+
+    const auto n = static_cast<std::size_t>(last - first);
+    if (n < ParallelPartitionCutoff)
+    {
+        token.ThrowIfStopRequested();
+        return std::partition(first, last, pred);
+    }
+
+    const auto numBlocks = static_cast<std::size_t>(pool.Size()) + 1;
+    auto blockBounds = [&](std::size_t block)
+    {
+        return SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+    };
+
+    std::vector<std::size_t> numTrue(numBlocks);
+    parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = blockBounds(block);
+            numTrue[block] = static_cast<std::size_t>(
+                std::partition(first + bounds.first, first + bounds.second, pred) - (first + bounds.first));
+        }
+    }, token);
+
+    auto boundary = std::size_t(0);
+    for (auto count : numTrue)
+    {
+        boundary += count;
+    }
+
+    // misplaced falses left of the boundary and trues right of it, in order
+    std::vector<interval> wrongLeft;
+    std::vector<interval> wrongRight;
+    for (auto block = 0u; block < numBlocks; ++block)
+    {
+        const auto bounds = blockBounds(block);
+        const auto split = bounds.first + numTrue[block];
+
+        const auto falseLast = std::min(bounds.second, boundary);
+        if (split < falseLast)
+        {
+            wrongLeft.emplace_back(split, falseLast);
+        }
+
+        const auto trueFirst = std::max(bounds.first, boundary);
+        if (trueFirst < split)
+        {
+            wrongRight.emplace_back(trueFirst, split);
+        }
+    }
+
+    // running totals so any pair index can be found with a binary search
+    auto prefixSums = [](const std::vector<interval>& intervals)
+    {
+        std::vector<std::size_t> sums(intervals.size() + 1, 0);
+        for (auto i = 0u; i < intervals.size(); ++i)
+        {
+            sums[i + 1] = sums[i] + (intervals[i].second - intervals[i].first);
+        }
+        return sums;
+    };
+    const auto leftSums = prefixSums(wrongLeft);
+    const auto rightSums = prefixSums(wrongRight);
+    const auto numMisplaced = leftSums.back();
+    if (numMisplaced == 0)
+    {
+        return first + boundary;
+    }
+
+    // position of the k-th misplaced element as (interval, offset in interval)
+    auto locate = [](const std::vector<std::size_t>& sums, std::size_t k)
+    {
+        const auto i = static_cast<std::size_t>(std::upper_bound(sums.begin(), sums.end(), k) - sums.begin()) - 1;
+        return std::make_pair(i, k - sums[i]);
+    };
+
+    parallel_for(pool, std::size_t(0), numMisplaced, [&](std::size_t pairFirst, std::size_t pairLast)
+    {
+        auto left = locate(leftSums, pairFirst);
+        auto right = locate(rightSums, pairFirst);
+        for (auto k = pairFirst; k < pairLast; ++k)
+        {
+            std::iter_swap(first + (wrongLeft[left.first].first + left.second),
+                first + (wrongRight[right.first].first + right.second));
+
+            if (++left.second == wrongLeft[left.first].second - wrongLeft[left.first].first)
+            {
+                ++left.first;
+                left.second = 0;
+            }
+            if (++right.second == wrongRight[right.first].second - wrongRight[right.first].first)
+            {
+                ++right.first;
+                right.second = 0;
+            }
+        }
+    }, token);
+
+    return first + boundary;
+}
+
+template <typename RandomIt, typename Predicate>
+RandomIt parallel_partition(RandomIt first, RandomIt last, Predicate pred, const stop_token& token = stop_token())
+{
+    return parallel_partition(thread_pool::Default(), first, last, pred, token);
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "parallel_partition.h"
+#include "quicksort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Ranges this short are never split into tasks, whatever the pool size
+*/
+constexpr std::size_t ParallelQuicksortCutoff = 1 << 13;
+
+/*
+Partitions [first, last) around the pivot at *first on the whole pool
+Returns [equalFirst, equalLast): less before it, the pivot (and its
+duplicates) inside, not less after it.
+If few elements are less than the pivot, which happens when it has many
+duplicates, a second pass pulls the duplicates out so the remainder shrinks.
+*/
+template <typename RandomIt, typename Compare>
+std::pair<RandomIt, RandomIt> ParallelPartitionAroundFirst(thread_pool& pool, RandomIt first, RandomIt last, Compare comp,
+    const stop_token& token)
+{
+    const auto& pivot = *first;
+    const auto lessLast = parallel_partition(pool, first + 1, last, [&](const auto& v) { return comp(v, pivot); }, token);
+
+    auto equalLast = lessLast;
+    if (static_cast<std::size_t>(lessLast - first) < static_cast<std::size_t>(last - first) / 8)
+    {
+        equalLast = parallel_partition(pool, lessLast, last, [&](const auto& v) { return !comp(pivot, v); }, token);
+    }
+
+    std::iter_swap(first, lessLast - 1);
+    return std::make_pair(lessLast - 1, equalLast);
+}
+
+/*
+One fork-join step of parallel_quicksort, see below
+*/
+template <typename RandomIt, typename Compare>
+void ParallelQuicksortTask(thread_pool& pool, RandomIt first, RandomIt last, Compare comp, std::size_t grainSize,
+    std::size_t parallelPartitionSize, unsigned int depthLimit, bool leftmost, const stop_token& token)
+{
+    // the smaller side of every partition becomes a task, this thread goes
+    // on with the larger one; a worker pushes tasks onto its own queue, so
+    // idle workers steal the oldest (largest) pending pieces
+    std::vector<std::future<void>> forks;
+    std::exception_ptr error;
+    try
+    {
+        while (static_cast<std::size_t>(last - first) > grainSize && depthLimit > 0)
+        {
+            token.ThrowIfStopRequested();
+            --depthLimit;
+
+            // near the top there are fewer ranges than threads, a serial
+            // partition there would leave the rest of the pool idle
+            ChoosePivot(first, last, comp);
+            std::pair<RandomIt, RandomIt> equal;
+            if (static_cast<std::size_t>(last - first) > parallelPartitionSize)
+            {
+                equal = ParallelPartitionAroundFirst(pool, first, last, comp, token);
+            }
+            else
+            {
+                const auto pivot = PartitionAroundFirst(first, last, comp);
+                equal = std::make_pair(pivot, pivot + 1);
+            }
+
+            auto smallFirst = first;
+            auto smallLast = equal.first;
+            auto smallLeftmost = leftmost;
+            if (equal.first - first < last - equal.second)
+            {
+                first = equal.second;
+                leftmost = false;
+            }
+            else
+            {
+                smallFirst = equal.second;
+                smallLast = last;
+                smallLeftmost = false;
+                last = equal.first;
+            }
+
+            if (static_cast<std::size_t>(smallLast - smallFirst) > ParallelQuicksortCutoff)
+            {
+                forks.push_back(pool.Submit([&pool, smallFirst, smallLast, comp, grainSize, parallelPartitionSize,
+                    depthLimit, smallLeftmost, token]
+                {
+                    ParallelQuicksortTask(pool, smallFirst, smallLast, comp, grainSize, parallelPartitionSize,
+                        depthLimit, smallLeftmost, token);
+                }));
+            }
+            else
+            {
+                IntroSortLoop(smallFirst, smallLast, comp, depthLimit, smallLeftmost, token);
+            }
+        }
+
+        // short enough, or the pivots kept going wrong and the depth limit
+        // hands the rest to heapsort
+        IntroSortLoop(first, last, comp, depthLimit, leftmost, token);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    // the forks work on the caller's range, all of them are waited on even
+    // after a failure; waiting runs queued tasks, ours or stolen, instead of blocking
+    for (auto& fork : forks)
+    {
+        pool.Wait(fork);
+    }
+    for (auto& fork : forks)
+    {
+        try
+        {
+            fork.get();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+/*
+Fork-join quicksort on a work-stealing pool
+
+Ranges are split while they are larger than the grain size, about 8 pieces
+per thread but never below ParallelQuicksortCutoff, so task overhead stays
+bounded, and then finished with IntroSort (quicksort.h), which shares the
+depth limit. Ranges larger than one thread's share are partitioned with
+parallel_partition, so the first levels are not a serial bottleneck.
+Waiting threads run pending tasks instead of blocking. The calling thread
+takes part, so it is safe to call from a pool task.
+*/
+template <typename RandomIt, typename Compare>
+void parallel_quicksort(thread_pool& pool, RandomIt first, RandomIt last, Compare comp,
+    const stop_token& token = stop_token())
+{
+    const auto n = static_cast<std::size_t>(last - first);
+    const auto grainSize = std::max(n / (8 * (pool.Size() + 1)), ParallelQuicksortCutoff);
+    const auto parallelPartitionSize = std::max(n / (pool.Size() + 1), ParallelPartitionCutoff);
+    ParallelQuicksortTask(pool, first, last, comp, grainSize, parallelPartitionSize, IntroSortDepthLimit(n), true, token);
+}
+
+template <typename RandomIt>
+void parallel_quicksort(thread_pool& pool, RandomIt first, RandomIt last)
+{
+    parallel_quicksort(pool, first, last, std::less<>());
+}
+
+template <typename RandomIt, typename Compare>
+void parallel_quicksort(RandomIt first, RandomIt last, Compare comp, const stop_token& token = stop_token())
+{
+    parallel_quicksort(thread_pool::Default(), first, last, comp, token);
+}
+
+template <typename RandomIt>
+void parallel_quicksort(RandomIt first, RandomIt last)
+{
+    parallel_quicksort(thread_pool::Default(), first, last, std::less<>());
+}
@@ -0,0 +1,418 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "parallel_for.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Parallel inclusive and exclusive scans (prefix sums) for any associative
+operator
+
+Two passes over pool.Size() + 1 slabs:
+- every thread reduces its slab to a single value
+- the slab sums are scanned serially, giving every slab its carry-in
+- every thread scans its slab again starting from its carry-in
+The input is read twice and the output written once, out may equal first.
+
+With AVX2 (/arch:AVX2, -mavx2), int and float sums over pointers or
+std::vector iterators (IsSimdScannable) reduce and scan 8 lanes at a time:
+log2(8) shifted adds give the prefix sums inside a register and the last lane
+carries into the next one. Float sums are reassociated, the result can differ
+from a serial scan in the last bits, as with std::inclusive_scan.
+*/
+
+/*
+Ranges shorter than this are scanned serially
+*/
+constexpr std::size_t ParallelScanCutoff = 1 << 16;
+
+template <typename InputIt, typename OutputIt, typename BinaryOp>
+constexpr bool IsSimdScannable()
+{
+#if defined(__AVX2__)
+    typedef typename std::iterator_traits<InputIt>::value_type value_type;
+    return (std::is_same<value_type, int>::value || std::is_same<value_type, float>::value)
+        && (std::is_same<BinaryOp, std::plus<>>::value || std::is_same<BinaryOp, std::plus<value_type>>::value)
+        && (std::is_same<InputIt, value_type*>::value || std::is_same<InputIt, const value_type*>::value
+            || std::is_same<InputIt, typename std::vector<value_type>::iterator>::value
+            || std::is_same<InputIt, typename std::vector<value_type>::const_iterator>::value)
+        && (std::is_same<OutputIt, value_type*>::value
+            || std::is_same<OutputIt, typename std::vector<value_type>::iterator>::value);
+#else
+    return false;
+#endif
+}
+
+#if defined(__AVX2__)
+
+/*
+8 lanes of an AVX2 register added up as prefix sums
+*/
+template <typename T>
+struct scan_lanes;
+
+template <>
+struct scan_lanes<int>
+{
+    typedef __m256i reg;
+
+    static reg Load(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static void Store(int* p, reg v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    static reg Zero() { return _mm256_setzero_si256(); }
+    static reg Set1(int v) { return _mm256_set1_epi32(v); }
+    static reg Add(reg a, reg b) { return _mm256_add_epi32(a, b); }
+    static reg BroadcastLast(reg v) { return _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(7)); }
+
+    static reg Prefix(reg v)
+    {
+        v = Add(v, _mm256_slli_si256(v, 4));
+        v = Add(v, _mm256_slli_si256(v, 8));
+        // the last lane of the low half carries into the high half
+        const auto low = _mm256_shuffle_epi32(v, 0xFF);
+        return Add(v, _mm256_permute2x128_si256(low, low, 0x08));
+    }
+
+    // lanes move up by one, carry fills lane 0
+    static reg ShiftIn(reg v, reg carry)
+    {
+        return _mm256_blend_epi32(_mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6)), carry, 1);
+    }
+};
+
+template <>
+struct scan_lanes<float>
+{
+    typedef __m256 reg;
+
+    static reg Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+    static reg Zero() { return _mm256_setzero_ps(); }
+    static reg Set1(float v) { return _mm256_set1_ps(v); }
+    static reg Add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg BroadcastLast(reg v) { return _mm256_permutevar8x32_ps(v, _mm256_set1_epi32(7)); }
+
+    static reg Prefix(reg v)
+    {
+        v = Add(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 4)));
+        v = Add(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 8)));
+        const auto low = _mm256_permute_ps(v, 0xFF);
+        return Add(v, _mm256_permute2f128_ps(low, low, 0x08));
+    }
+
+    static reg ShiftIn(reg v, reg carry)
+    {
+        return _mm256_blend_ps(_mm256_permutevar8x32_ps(v, _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6)), carry, 1);
+    }
+};
+
+template <typename T>
+T SimdSum(const T* data, std::size_t size, T sum)
+{
+    typedef scan_lanes<T> lanes;
+    auto acc = lanes::Zero();
+    auto i = std::size_t(0);
+    for (; i + 8 <= size; i += 8)
+    {
+        acc = lanes::Add(acc, lanes::Load(data + i));
+    }
+    T partial[8];
+    lanes::Store(partial, acc);
+    for (auto lane : partial)
+    {
+        sum += lane;
+    }
+    for (; i < size; ++i)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
+
+/*
+out[i] = carry + in[0] + ... + in[i], returns the carry for what follows
+*/
+template <typename T>
+T SimdInclusiveScan(const T* in, T* out, std::size_t size, T carry)
+{
+    typedef scan_lanes<T> lanes;
+    auto carryLanes = lanes::Set1(carry);
+    auto i = std::size_t(0);
+    for (; i + 8 <= size; i += 8)
+    {
+        const auto sums = lanes::Add(lanes::Prefix(lanes::Load(in + i)), carryLanes);
+        lanes::Store(out + i, sums);
+        carryLanes = lanes::BroadcastLast(sums);
+    }
+    if (i > 0)
+    {
+        carry = out[i - 1];
+    }
+    for (; i < size; ++i)
+    {
+        carry += in[i];
+        out[i] = carry;
+    }
+    return carry;
+}
+
+/*
+out[i] = carry + in[0] + ... + in[i - 1], returns the carry for what follows
+*/
+template <typename T>
+T SimdExclusiveScan(const T* in, T* out, std::size_t size, T carry)
+{
+    typedef scan_lanes<T> lanes;
+    auto carryLanes = lanes::Set1(carry);
+    auto i = std::size_t(0);
+    for (; i + 8 <= size; i += 8)
+    {
+        const auto sums = lanes::Add(lanes::Prefix(lanes::Load(in + i)), carryLanes);
+        lanes::Store(out + i, lanes::ShiftIn(sums, carryLanes));
+        carryLanes = lanes::BroadcastLast(sums);
+    }
+    if (i > 0)
+    {
+        T last[8];
+        lanes::Store(last, carryLanes);
+        carry = last[0];
+    }
+    for (; i < size; ++i)
+    {
+        const auto value = in[i];
+        out[i] = carry;
+        carry += value;
+    }
+    return carry;
+}
+
+#endif
+
+/*
+SIMD kernels apply when the carried value has the element type as well
+*/
+template <typename InputIt, typename OutputIt, typename T, typename BinaryOp>
+constexpr bool IsSimdScan()
+{
+    return IsSimdScannable<InputIt, OutputIt, BinaryOp>() && std::is_same<T, typename std::iterator_traits<InputIt>::value_type>::value;
+}
+
+/*
+Left fold of [first, last) onto sum
+*/
+template <typename InputIt, typename T, typename BinaryOp>
+T ScanReduce(InputIt first, InputIt last, T sum, BinaryOp op)
+{
+    if constexpr (IsSimdScan<InputIt, T*, T, BinaryOp>())
+    {
+        return (first != last) ? SimdSum(std::addressof(*first), static_cast<std::size_t>(last - first), sum) : sum;
+    }
+    else
+    {
+        for (; first != last; ++first)
+        {
+            sum = op(sum, *first);
+        }
+        return sum;
+    }
+}
+
+template <typename InputIt, typename OutputIt, typename T, typename BinaryOp>
+T ScanInclusive(InputIt first, InputIt last, OutputIt out, T carry, BinaryOp op)
+{
+    if constexpr (IsSimdScan<InputIt, OutputIt, T, BinaryOp>())
+    {
+        return (first != last)
+            ? SimdInclusiveScan(std::addressof(*first), std::addressof(*out), static_cast<std::size_t>(last - first), carry)
+            : carry;
+    }
+    else
+    {
+        for (; first != last; ++first, ++out)
+        {
+            carry = op(carry, *first);
+            *out = carry;
+        }
+        return carry;
+    }
+}
+
+template <typename InputIt, typename OutputIt, typename T, typename BinaryOp>
+T ScanExclusive(InputIt first, InputIt last, OutputIt out, T carry, BinaryOp op)
+{
+    if constexpr (IsSimdScan<InputIt, OutputIt, T, BinaryOp>())
+    {
+        return (first != last)
+            ? SimdExclusiveScan(std::addressof(*first), std::addressof(*out), static_cast<std::size_t>(last - first), carry)
+            : carry;
+    }
+    else
+    {
+        for (; first != last; ++first, ++out)
+        {
+            const T value = *first; // out may be first
+            *out = carry;
+            carry = op(carry, value);
+        }
+        return carry;
+    }
+}
+
+/*
+out[i] = first[0] op first[1] op ... op first[i], returns the end of out
+*/
+template <typename InputIt, typename OutputIt, typename BinaryOp>
+OutputIt parallel_inclusive_scan(thread_pool& pool, InputIt first, InputIt last, OutputIt out, BinaryOp op,
+    const stop_token& token = stop_token())
+{
+    typedef typename std::iterator_traits<InputIt>::value_type value_type;
+
+    const auto n = static_cast<std::size_t>(last - first);
+    if (n == 0)
+    {
+        return out;
+    }
+    const auto numBlocks = static_cast<std::size_t>(pool.Size()) + 1;
+    if (n < ParallelScanCutoff || numBlocks == 1)
+    {
+        token.ThrowIfStopRequested();
+        *out = *first;
+        ScanInclusive(first + 1, last, out + 1, static_cast<value_type>(*out), op);
+        return out + n;
+    }
+
+    auto blockBounds = [&](std::size_t block)
+    {
+        return SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+    };
+
+    // the last block's sum is never needed
+    std::vector<value_type> carries(numBlocks);
+    parallel_for(pool, std::size_t(0), numBlocks - 1, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = blockBounds(block);
+            const value_type head = first[bounds.first];
+            carries[block + 1] = ScanReduce(first + (bounds.first + 1), first + bounds.second, head, op);
+        }
+    }, token);
+
+    for (auto block = std::size_t(2); block < numBlocks; ++block)
+    {
+        carries[block] = op(carries[block - 1], carries[block]);
+    }
+
+    parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = blockBounds(block);
+            if (block == 0)
+            {
+                *out = *first;
+                ScanInclusive(first + 1, first + bounds.second, out + 1, static_cast<value_type>(*out), op);
+            }
+            else
+            {
+                ScanInclusive(first + bounds.first, first + bounds.second, out + bounds.first, carries[block], op);
+            }
+        }
+    }, token);
+    return out + n;
+}
+
+template <typename InputIt, typename OutputIt>
+OutputIt parallel_inclusive_scan(thread_pool& pool, InputIt first, InputIt last, OutputIt out)
+{
+    return parallel_inclusive_scan(pool, first, last, out, std::plus<>());
+}
+
+template <typename InputIt, typename OutputIt, typename BinaryOp>
+OutputIt parallel_inclusive_scan(InputIt first, InputIt last, OutputIt out, BinaryOp op, const stop_token& token = stop_token())
+{
+    return parallel_inclusive_scan(thread_pool::Default(), first, last, out, op, token);
+}
+
+template <typename InputIt, typename OutputIt>
+OutputIt parallel_inclusive_scan(InputIt first, InputIt last, OutputIt out)
+{
+    return parallel_inclusive_scan(thread_pool::Default(), first, last, out, std::plus<>());
+}
+
+/*
+out[i] = init op first[0] op ... op first[i - 1], returns the end of out
+*/
+template <typename InputIt, typename OutputIt, typename T, typename BinaryOp>
+OutputIt parallel_exclusive_scan(thread_pool& pool, InputIt first, InputIt last, OutputIt out, T init, BinaryOp op,
+    const stop_token& token = stop_token())
+{
+    const auto n = static_cast<std::size_t>(last - first);
+    const auto numBlocks = static_cast<std::size_t>(pool.Size()) + 1;
+    if (n < ParallelScanCutoff || numBlocks == 1)
+    {
+        token.ThrowIfStopRequested();
+        ScanExclusive(first, last, out, init, op);
+        return out + n;
+    }
+
+    auto blockBounds = [&](std::size_t block)
+    {
+        return SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+    };
+
+    std::vector<T> carries(numBlocks, init);
+    parallel_for(pool, std::size_t(0), numBlocks - 1, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = blockBounds(block);
+            const T head = first[bounds.first];
+            carries[block + 1] = ScanReduce(first + (bounds.first + 1), first + bounds.second, head, op);
+        }
+    }, token);
+
+    for (auto block = std::size_t(1); block < numBlocks; ++block)
+    {
+        carries[block] = op(carries[block - 1], carries[block]);
+    }
+
+    parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = blockBounds(block);
+            ScanExclusive(first + bounds.first, first + bounds.second, out + bounds.first, carries[block], op);
+        }
+    }, token);
+    return out + n;
+}
+
+template <typename InputIt, typename OutputIt, typename T>
+OutputIt parallel_exclusive_scan(thread_pool& pool, InputIt first, InputIt last, OutputIt out, T init)
+{
+    return parallel_exclusive_scan(pool, first, last, out, init, std::plus<>());
+}
+
+template <typename InputIt, typename OutputIt, typename T, typename BinaryOp>
+OutputIt parallel_exclusive_scan(InputIt first, InputIt last, OutputIt out, T init, BinaryOp op,
+    const stop_token& token = stop_token())
+{
+    return parallel_exclusive_scan(thread_pool::Default(), first, last, out, init, op, token);
+}
+
+template <typename InputIt, typename OutputIt, typename T>
+OutputIt parallel_exclusive_scan(InputIt first, InputIt last, OutputIt out, T init)
+{
+    return parallel_exclusive_scan(thread_pool::Default(), first, last, out, init, std::plus<>());
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.h"
+#include "parallel_partition.h"
+#include "parallel_quicksort.h"
+#include "quicksort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Largest k for which parallel_partial_sort keeps a bounded heap per thread,
+above it the k smallest are found by parallel selection
+*/
+constexpr std::size_t ParallelPartialSortHeapLimit = 1 << 12;
+
+/*
+Parallel nth_element: afterwards *nth is the element a full sort would put
+there, nothing before it is greater and nothing after it is less
+
+Quickselect where every step partitions the range on the whole pool
+(ParallelPartitionAroundFirst) and only the side holding nth is kept. Below
+ParallelPartitionCutoff, or once the pivots went wrong too often,
+std::nth_element finishes the remaining range.
+*/
+template <typename RandomIt, typename Compare>
+void parallel_nth_element(thread_pool& pool, RandomIt first, RandomIt nth, RandomIt last, Compare comp,
+    const stop_token& token = stop_token())
+{
+    if (nth == last)
+    {
+        return;
+    }
+
+    auto depthLimit = IntroSortDepthLimit(static_cast<std::size_t>(last - first));
+    while (static_cast<std::size_t>(last - first) > ParallelPartitionCutoff && depthLimit > 0)
+    {
+        token.ThrowIfStopRequested();
+        --depthLimit;
+
+        ChoosePivot(first, last, comp);
+        const auto equal = ParallelPartitionAroundFirst(pool, first, last, comp, token);
+        if (nth < equal.first)
+        {
+            last = equal.first;
+        }
+        else if (nth >= equal.second)
+        {
+            first = equal.second;
+        }
+        else
+        {
+            return; // nth is a copy of the pivot
+        }
+    }
+
+    token.ThrowIfStopRequested();
+    std::nth_element(first, nth, last, comp);
+}
+
+template <typename RandomIt>
+void parallel_nth_element(thread_pool& pool, RandomIt first, RandomIt nth, RandomIt last)
+{
+    parallel_nth_element(pool, first, nth, last, std::less<>());
+}
+
+template <typename RandomIt, typename Compare>
+void parallel_nth_element(RandomIt first, RandomIt nth, RandomIt last, Compare comp, const stop_token& token = stop_token())
+{
+    parallel_nth_element(thread_pool::Default(), first, nth, last, comp, token);
+}
+
+template <typename RandomIt>
+void parallel_nth_element(RandomIt first, RandomIt nth, RandomIt last)
+{
+    parallel_nth_element(thread_pool::Default(), first, nth, last, std::less<>());
+}
+
+/*
+Parallel partial_sort: afterwards [first, middle) holds the middle - first
+smallest elements in order, the rest is left in unspecified order
+
+For k = middle - first up to ParallelPartialSortHeapLimit every thread scans
+its own block once, keeping the positions of its k smallest elements in a
+max-heap; most elements are rejected with a single comparison against the
+heap top. The candidates of all threads are narrowed down to k, swapped to
+the front and sorted. Larger k use parallel_nth_element and sort the front
+with parallel_quicksort.
+
+Pass std::greater<>() for the k largest, e.g. the peaks of a spectrum.
+*/
+template <typename RandomIt, typename Compare>
+void parallel_partial_sort(thread_pool& pool, RandomIt first, RandomIt middle, RandomIt last, Compare comp,
+    const stop_token& token = stop_token())
+{
+    const auto n = static_cast<std::size_t>(last - first);
+    const auto k = static_cast<std::size_t>(middle - first);
+    const auto numBlocks = static_cast<std::size_t>(pool.Size()) + 1;
+    if (k == 0)
+    {
+        return;
+    }
+    if (n < ParallelPartitionCutoff || numBlocks == 1)
+    {
+        token.ThrowIfStopRequested();
+        std::partial_sort(first, middle, last, comp);
+        return;
+    }
+
+    if (k > ParallelPartialSortHeapLimit)
+    {
+        parallel_nth_element(pool, first, middle, last, comp, token);
+        parallel_quicksort(pool, first, middle, comp, token);
+        return;
+    }
+
+    auto before = [&](std::size_t a, std::size_t b) { return comp(first[a], first[b]); };
+
+    std::vector<std::vector<std::size_t>> heaps(numBlocks);
+    parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            auto& heap = heaps[block];
+            heap.reserve(k);
+            const auto bounds = SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+            for (auto i = bounds.first; i < bounds.second; ++i)
+            {
+                if (heap.size() < k)
+                {
+                    heap.push_back(i);
+                    std::push_heap(heap.begin(), heap.end(), before);
+                }
+                else if (comp(first[i], first[heap.front()]))
+                {
+                    std::pop_heap(heap.begin(), heap.end(), before);
+                    heap.back() = i;
+                    std::push_heap(heap.begin(), heap.end(), before);
+                }
+            }
+        }
+    }, token);
+
+    // the k smallest of all candidates are the k smallest overall
+    std::vector<std::size_t> selected;
+    for (const auto& heap : heaps)
+    {
+        selected.insert(selected.end(), heap.begin(), heap.end());
+    }
+    std::nth_element(selected.begin(), selected.begin() + (k - 1), selected.end(), before);
+    selected.resize(k);
+    std::sort(selected.begin(), selected.end());
+
+    // selected positions past middle trade places with unselected ones before it
+    auto outside = selected.begin();
+    std::vector<std::size_t> holes;
+    for (auto position = std::size_t(0); position < k; ++position)
+    {
+        if (outside != selected.end() && *outside == position)
+        {
+            ++outside;
+        }
+        else
+        {
+            holes.push_back(position);
+        }
+    }
+    for (auto hole : holes)
+    {
+        std::iter_swap(first + hole, first + *outside++);
+    }
+
+    token.ThrowIfStopRequested();
+    IntroSort(first, middle, comp);
+}
+
+template <typename RandomIt>
+void parallel_partial_sort(thread_pool& pool, RandomIt first, RandomIt middle, RandomIt last)
+{
+    parallel_partial_sort(pool, first, middle, last, std::less<>());
+}
+
+template <typename RandomIt, typename Compare>
+void parallel_partial_sort(RandomIt first, RandomIt middle, RandomIt last, Compare comp, const stop_token& token = stop_token())
+{
+    parallel_partial_sort(thread_pool::Default(), first, middle, last, comp, token);
+}
+
+template <typename RandomIt>
+void parallel_partial_sort(RandomIt first, RandomIt middle, RandomIt last)
+{
+    parallel_partial_sort(thread_pool::Default(), first, middle, last, std::less<>());
+}
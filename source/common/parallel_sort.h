@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.h"
+#include "parallel_merge.h"
+#include "parallel_quicksort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Generic parallel sorts over random access iterators
+
+Both take a comparator and a projection, elements are ordered by
+comp(proj(a), proj(b)), so records are sorted by one of their fields in
+place, e.g. parallel_sort(pool, v.begin(), v.end(), std::less<>(), [](const record& r) { return r.key; })
+*/
+
+/*
+Projection that returns its argument, the default
+*/
+struct identity
+{
+    template <typename T>
+    T&& operator()(T&& value) const
+    {
+        return std::forward<T>(value);
+    }
+};
+
+/*
+Compares projected elements
+*/
+template <typename Compare, typename Projection>
+struct projected_compare
+{
+    Compare comp;
+    Projection proj;
+
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const
+    {
+        return comp(proj(a), proj(b));
+    }
+};
+
+/*
+The comparator the sorts actually use; without a projection that is comp
+itself, which keeps the SIMD base case (simd_sort.h) for plain int and float keys
+*/
+template <typename Compare, typename Projection>
+auto ProjectedCompare(Compare comp, Projection proj)
+{
+    if constexpr (std::is_same<Projection, identity>::value)
+    {
+        return comp;
+    }
+    else
+    {
+        return projected_compare<Compare, Projection>{ comp, proj };
+    }
+}
+
+/*
+Below this many elements parallel_stable_sort runs std::stable_sort
+*/
+constexpr std::size_t ParallelStableSortCutoff = 1 << 15;
+
+/*
+Unstable parallel sort, in place: parallel_quicksort (fork-join on the pool,
+parallel partitioning at the top, introsort below the grain size)
+*/
+template <typename RandomIt, typename Compare = std::less<>, typename Projection = identity>
+void parallel_sort(thread_pool& pool, RandomIt first, RandomIt last, Compare comp = Compare(),
+    Projection proj = Projection(), const stop_token& token = stop_token())
+{
+    parallel_quicksort(pool, first, last, ProjectedCompare(comp, proj), token);
+}
+
+template <typename RandomIt, typename Compare = std::less<>, typename Projection = identity>
+void parallel_sort(RandomIt first, RandomIt last, Compare comp = Compare(), Projection proj = Projection(),
+    const stop_token& token = stop_token())
+{
+    parallel_sort(thread_pool::Default(), first, last, comp, proj, token);
+}
+
+/*
+Stable parallel merge sort with a scratch buffer of n elements
+
+Every thread stable sorts one contiguous block in place, then all blocks are
+merged into the buffer in a single pass with parallel_multiway_merge, which
+keeps equal elements in block order, and moved back.
+value_type must be default constructible (the buffer is a std::vector).
+*/
+template <typename RandomIt, typename Compare = std::less<>, typename Projection = identity>
+void parallel_stable_sort(thread_pool& pool, RandomIt first, RandomIt last, Compare comp = Compare(),
+    Projection proj = Projection(), const stop_token& token = stop_token())
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+
+    const auto projected = ProjectedCompare(comp, proj);
+    const auto n = static_cast<std::size_t>(last - first);
+    const auto numBlocks = static_cast<std::size_t>(pool.Size()) + 1;
+    if (n < ParallelStableSortCutoff || numBlocks == 1)
+    {
+        token.ThrowIfStopRequested();
+        std::stable_sort(first, last, projected);
+        return;
+    }
+
+    std::vector<std::pair<RandomIt, RandomIt>> blocks(numBlocks);
+    parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+            blocks[block] = std::make_pair(first + bounds.first, first + bounds.second);
+            std::stable_sort(blocks[block].first, blocks[block].second, projected);
+        }
+    }, token);
+
+    std::vector<value_type> buffer(n);
+    parallel_multiway_merge(pool, blocks, buffer.begin(), projected, token);
+
+    parallel_for(pool, std::size_t(0), n, [&](std::size_t chunkFirst, std::size_t chunkLast)
+    {
+        std::move(buffer.begin() + chunkFirst, buffer.begin() + chunkLast, first + chunkFirst);
+    }, token);
+}
+
+template <typename RandomIt, typename Compare = std::less<>, typename Projection = identity>
+void parallel_stable_sort(RandomIt first, RandomIt last, Compare comp = Compare(), Projection proj = Projection(),
+    const stop_token& token = stop_token())
+{
+    parallel_stable_sort(thread_pool::Default(), first, last, comp, proj, token);
+}
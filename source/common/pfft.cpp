@@ -1,105 +1,105 @@
-#include <future>
+#include <algorithm>
 
 #include "fft.h"
+#include "numa.h"
+#include "parallel_for.h"
 #include "pfft.h"
 
-matrix<std::complex<double>> PFFT(const matrix<std::complex<double>>& data,
-    matrix<std::complex<double>>& intermediate)
+namespace
+{
+    typedef matrix<std::complex<double>> complex_matrix;
+    typedef matrix<std::complex<double>, first_touch_allocator<std::complex<double>>> first_touch_matrix;
+
+    const unsigned int TransposeTile = 32; // 32 * 32 * 16 bytes, fits L1 for src and dst
+    const unsigned int RowsPerChunk = 8;   // token is checked every RowsPerChunk rows
+
+    /*
+    Rows [rowFirst, rowLast) of dst become the matching columns of src, in tiles
+    so both sides are read and written a cache line at a time
+    */
+    template <typename Source, typename Destination>
+    void TransposeRows(const Source& src, Destination& dst, unsigned int rowFirst, unsigned int rowLast)
+    {
+        const auto srcHeight = static_cast<unsigned int>(src.Height());
+        for (auto y0 = rowFirst; y0 < rowLast; y0 += TransposeTile)
+        {
+            const auto y1 = std::min(y0 + TransposeTile, rowLast);
+            for (auto x0 = 0u; x0 < srcHeight; x0 += TransposeTile)
+            {
+                const auto x1 = std::min(x0 + TransposeTile, srcHeight);
+                for (auto y = y0; y < y1; ++y)
+                {
+                    for (auto x = x0; x < x1; ++x)
+                    {
+                        dst.At(x, y) = src.At(y, x);
+                    }
+                }
+            }
+        }
+    }
+}
+
+matrix<std::complex<double>> PFFT(thread_pool& pool, const matrix<std::complex<double>>& data,
+    matrix<std::complex<double>>& intermediate, const stop_token& token)
 {
-    matrix<std::complex<double>> dataExtended(data);
     const auto N = RoundUpPowerOf2(static_cast<unsigned int>(data.Width()));
     const auto M = RoundUpPowerOf2(static_cast<unsigned int>(data.Height()));
-    dataExtended.Resize(N, M);
 
     const auto bitRevN = GenBitReversal(N);
     const auto bitRevM = GenBitReversal(M);
     const auto twiddleN = GenTwiddleFactors(N / 2);
     const auto twiddleM = GenTwiddleFactors(M / 2);
 
-    const auto numThreads = std::thread::hardware_concurrency();
-    std::vector<std::future<matrix<std::complex<double>>>> threads(numThreads - 1);
+    // Every pass is a static schedule over rows and the buffers PFFT keeps to
+    // itself are first touched by the worker that owns their rows, so with a
+    // pinned pool each worker reads its input rows from its own NUMA node. The
+    // column pass is done as a row pass over the transpose: the only cross-node
+    // traffic left is the two tiled transposes instead of a strided read per
+    // element. intermediate and the result are handed back as plain matrices,
+    // their pages are placed by the calling thread that initializes them.
 
+    // rows, zero-padded to N
+    first_touch_matrix dataExtended(N, M, MakeFirstTouchVector<std::complex<double>>(pool, M, N));
+    intermediate = complex_matrix(N, M);
+    const auto srcWidth = static_cast<unsigned int>(data.Width());
+    const auto srcHeight = static_cast<unsigned int>(data.Height());
+    parallel_for_static(pool, 0u, M, RowsPerChunk, [&](unsigned int first, unsigned int last)
     {
-        const auto numTasksPerThread = M / static_cast<float>(numThreads - 1); // main thread won't work
-        auto first = 0u;
-        for (auto i = 0u; i < numThreads - 1; ++i)
+        for (auto y = first; y < last; ++y)
         {
-            const auto last = static_cast<unsigned int>(round(numTasksPerThread * (i + 1)));
-            const auto range = last - first;
-            matrix<std::complex<double>> partialData(N, range);
-            for (auto j = 0u; j < range; ++j)
+            if (y < srcHeight)
             {
-                partialData.Row(j, dataExtended.Row(first + j));
-            }
-            first = last;
-
-            threads[i] = std::async([=]
-            {
-                matrix<std::complex<double>> partialIntermediate(N, range);
-                for (auto y = 0u; y < range; ++y)
+                for (auto x = 0u; x < srcWidth; ++x)
                 {
-                    auto rowData = partialData.Row(y);
-                    partialIntermediate.Row(y, FFT(rowData, bitRevN, twiddleN));
+                    dataExtended.At(x, y) = data.At(x, y);
                 }
-                return partialIntermediate;
-            });
-        }
-    }
-
-    intermediate.Resize(N, M);
-    {
-        auto lastRowAppended = 0u;
-        for (auto i = 0u; i < numThreads - 1; ++i)
-        {
-            auto partialData = threads[i].get();
-            for (auto j = 0; j < partialData.Height(); ++j)
-            {
-                intermediate.Row(lastRowAppended, partialData.Row(j));
-                ++lastRowAppended;
             }
+            intermediate.Row(y, FFT(dataExtended.Row(y), bitRevN, twiddleN));
         }
-    }
+    }, token);
 
+    // columns, as rows of the transpose
+    first_touch_matrix transposed(M, N, MakeFirstTouchVector<std::complex<double>>(pool, N, M));
+    parallel_for_static(pool, 0u, N, RowsPerChunk, [&](unsigned int first, unsigned int last)
     {
-        const auto numTasksPerThread = N / static_cast<float>(numThreads - 1); // main thread won't work
-        auto first = 0u;
-        for (auto i = 0u; i < numThreads - 1; ++i)
+        TransposeRows(intermediate, transposed, first, last);
+        for (auto x = first; x < last; ++x)
         {
-            const auto last = static_cast<unsigned int>(round(numTasksPerThread * (i + 1)));
-            const auto range = last - first;
-            matrix<std::complex<double>> partialData(range, M);
-            for (auto j = 0u; j < range; ++j)
-            {
-                partialData.Col(j, intermediate.Col(first + j));
-            }
-            first = last;
-
-            threads[i] = std::async([=]
-            {
-                matrix<std::complex<double>> partialIntermediate(range, M);
-                for (auto x = 0u; x < range; ++x)
-                {
-                    auto colData = partialData.Col(x);
-                    partialIntermediate.Col(x, FFT(colData, bitRevM, twiddleM));
-                }
-                return partialIntermediate;
-            });
+            transposed.Row(x, FFT(transposed.Row(x), bitRevM, twiddleM));
         }
-    }
+    }, token);
 
-    matrix<std::complex<double>> result(N, M);
+    complex_matrix result(N, M);
+    parallel_for_static(pool, 0u, M, RowsPerChunk, [&](unsigned int first, unsigned int last)
     {
-        auto lastColAppended = 0u;
-        for (auto i = 0u; i < numThreads - 1; ++i)
-        {
-            auto partialData = threads[i].get();
-            for (auto j = 0; j < partialData.Width(); ++j)
-            {
-                result.Col(lastColAppended, partialData.Col(j));
-                ++lastColAppended;
-            }
-        }
-    }
+        TransposeRows(transposed, result, first, last);
+    }, token);
 
     return result;
-}
\ No newline at end of file
+}
+
+matrix<std::complex<double>> PFFT(const matrix<std::complex<double>>& data,
+    matrix<std::complex<double>>& intermediate, const stop_token& token)
+{
+    return PFFT(thread_pool::Default(), data, intermediate, token);
+}
@@ -4,6 +4,15 @@
 #include <complex>
 
 #include "matrix.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+FFT of every row then of every column, rows and columns are spread over the pool
+Throws operation_cancelled if a stop is requested on token before it finishes
+*/
+matrix<std::complex<double>> PFFT(thread_pool& pool, const matrix<std::complex<double>>& data,
+    matrix<std::complex<double>>& intermediate, const stop_token& token = stop_token());
 
 matrix<std::complex<double>> PFFT(const matrix<std::complex<double>>& data,
-    matrix<std::complex<double>>& intermediate);
+    matrix<std::complex<double>>& intermediate, const stop_token& token = stop_token());
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+#include "simd_sort.h"
+#include "stop_token.h"
+
+/*
+Quicksort building blocks shared by the sort studies and parallel_quicksort
+
+Taking the first element as the pivot makes sorted input quadratic. These
+pick the pivot from a sample spread over the range, give up on quicksort for
+heapsort once the recursion gets too deep, and handle long runs of equal
+keys with a three-way partition.
+*/
+
+/*
+Ranges this short are finished with an insertion sort
+*/
+constexpr std::size_t InsertionSortThreshold = 24;
+
+template <typename RandomIt, typename Compare>
+void InsertionSort(RandomIt first, RandomIt last, Compare comp)
+{
+    if (first == last)
+    {
+        return;
+    }
+
+    for (auto i = first + 1; i != last; ++i)
+    {
+        auto value = std::move(*i);
+        auto j = i;
+        for (; j != first && comp(value, *(j - 1)); --j)
+        {
+            *j = std::move(*(j - 1));
+        }
+        *j = std::move(value);
+    }
+}
+
+template <typename RandomIt, typename Compare>
+void HeapSort(RandomIt first, RandomIt last, Compare comp)
+{
+    std::make_heap(first, last, comp);
+    std::sort_heap(first, last, comp);
+}
+
+/*
+Sorts a short range, with the SIMD network (simd_sort.h) where the key type allows it
+*/
+template <typename RandomIt, typename Compare>
+void SmallSort(RandomIt first, RandomIt last, Compare comp)
+{
+    if constexpr (IsSimdSortable<RandomIt, Compare>())
+    {
+        if (first != last)
+        {
+            SimdSortSmall(&*first, static_cast<std::size_t>(last - first));
+        }
+    }
+    else
+    {
+        InsertionSort(first, last, comp);
+    }
+}
+
+/*
+Recursion depth after which introsort switches to heapsort, 2 * floor(log2(n))
+*/
+inline unsigned int IntroSortDepthLimit(std::size_t n)
+{
+    auto depth = 0u;
+    while (n > 1)
+    {
+        n >>= 1;
+        depth += 2;
+    }
+    return depth;
+}
+
+template <typename T, typename Compare>
+const T& MedianOfThree(const T& a, const T& b, const T& c, Compare comp)
+{
+    if (comp(a, b))
+    {
+        return comp(b, c) ? b : (comp(a, c) ? c : a);
+    }
+    return comp(a, c) ? a : (comp(b, c) ? c : b);
+}
+
+/*
+Sorts the three elements in place, afterwards *b is their median
+*/
+template <typename RandomIt, typename Compare>
+void SortThree(RandomIt a, RandomIt b, RandomIt c, Compare comp)
+{
+    if (comp(*b, *a))
+    {
+        std::iter_swap(a, b);
+    }
+    if (comp(*c, *b))
+    {
+        std::iter_swap(b, c);
+        if (comp(*b, *a))
+        {
+            std::iter_swap(a, b);
+        }
+    }
+}
+
+/*
+Moves the pivot to *first: median of first, middle and last, or for larger
+ranges Tukey's ninther (median of three medians of three), which keeps
+sorted, reverse sorted and organ-pipe inputs balanced
+*/
+template <typename RandomIt, typename Compare>
+void ChoosePivot(RandomIt first, RandomIt last, Compare comp)
+{
+    const auto n = last - first;
+    const auto mid = first + n / 2;
+    if (n > 128)
+    {
+        const auto step = n / 8;
+        SortThree(first, first + step, first + 2 * step, comp);
+        SortThree(mid - step, mid, mid + step, comp);
+        SortThree(last - 1 - 2 * step, last - 1 - step, last - 1, comp);
+        SortThree(first + step, mid, last - 1 - step, comp);
+    }
+    else
+    {
+        SortThree(first, mid, last - 1, comp);
+    }
+    std::iter_swap(first, mid);
+}
+
+/*
+Hoare partition around the pivot at *first, returns where the pivot ends up
+Everything before it is not greater, everything after it is not less.
+Elements equal to the pivot stop both scans, so duplicates split evenly.
+*/
+template <typename RandomIt, typename Compare>
+RandomIt PartitionAroundFirst(RandomIt first, RandomIt last, Compare comp)
+{
+    auto i = first;
+    auto j = last;
+    while (true)
+    {
+        do
+        {
+            ++i;
+        } while (i != last && comp(*i, *first));
+
+        do
+        {
+            --j;
+        } while (comp(*first, *j));
+
+        if (!(i < j))
+        {
+            break;
+        }
+        std::iter_swap(i, j);
+    }
+    std::iter_swap(first, j);
+    return j;
+}
+
+/*
+Dijkstra's three-way partition around the pivot at *first
+Returns [equalFirst, equalLast): less before it, equal inside, greater after.
+*/
+template <typename RandomIt, typename Compare>
+std::pair<RandomIt, RandomIt> PartitionThreeWay(RandomIt first, RandomIt last, Compare comp)
+{
+    // [first, lt) less, [lt, i) equal, [gt, last) greater; *lt is always a
+    // copy of the pivot so it is compared against in place
+    auto lt = first;
+    auto i = first + 1;
+    auto gt = last;
+    while (i < gt)
+    {
+        if (comp(*i, *lt))
+        {
+            std::iter_swap(lt, i);
+            ++lt;
+            ++i;
+        }
+        else if (comp(*lt, *i))
+        {
+            --gt;
+            std::iter_swap(i, gt);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return std::make_pair(lt, gt);
+}
+
+/*
+Introsort of [first, last) with at most depthLimit levels of quicksort
+
+leftmost is false when *(first - 1) is known to be not greater than anything
+in the range. If the pivot then equals that element, the range starts with a
+run of keys equal to it and a three-way partition strips the whole run in
+one pass, so heavy duplicates cost linear time instead of log n passes.
+*/
+template <typename RandomIt, typename Compare>
+void IntroSortLoop(RandomIt first, RandomIt last, Compare comp, unsigned int depthLimit, bool leftmost,
+    const stop_token& token = stop_token())
+{
+    const auto smallSize = IsSimdSortable<RandomIt, Compare>() ? SimdSortMaxSize : InsertionSortThreshold;
+    while (static_cast<std::size_t>(last - first) > smallSize)
+    {
+        token.ThrowIfStopRequested(); // every partition is a chunk boundary
+
+        if (depthLimit == 0)
+        {
+            HeapSort(first, last, comp);
+            return;
+        }
+        --depthLimit;
+
+        ChoosePivot(first, last, comp);
+        if (!leftmost && !comp(*(first - 1), *first))
+        {
+            first = PartitionThreeWay(first, last, comp).second;
+            continue;
+        }
+
+        const auto pivot = PartitionAroundFirst(first, last, comp);
+
+        // recurse into the smaller side so the stack stays O(log n)
+        if (pivot - first < last - pivot)
+        {
+            IntroSortLoop(first, pivot, comp, depthLimit, leftmost, token);
+            first = pivot + 1;
+            leftmost = false;
+        }
+        else
+        {
+            IntroSortLoop(pivot + 1, last, comp, depthLimit, false, token);
+            last = pivot;
+        }
+    }
+    SmallSort(first, last, comp);
+}
+
+/*
+Single-threaded introsort: ninther pivots, heapsort past 2 * log2(n) levels,
+three-way partitioning of duplicate runs and insertion sort or a SIMD sorting
+network for short ranges
+*/
+template <typename RandomIt, typename Compare>
+void IntroSort(RandomIt first, RandomIt last, Compare comp, const stop_token& token = stop_token())
+{
+    IntroSortLoop(first, last, comp, IntroSortDepthLimit(static_cast<std::size_t>(last - first)), true, token);
+}
+
+template <typename RandomIt>
+void IntroSort(RandomIt first, RandomIt last)
+{
+    IntroSort(first, last, std::less<>());
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Below this many elements the sort falls back to std::stable_sort
+*/
+constexpr std::size_t RadixSortCutoff = 1 << 14;
+
+/*
+Maps an integer or IEEE float key to an unsigned integer of the same width
+whose unsigned order is the key's order:
+signed integers get their sign bit flipped, negative floats all their bits
+and non-negative floats only the sign bit.
+-0.0 sorts before +0.0 and NaNs go to the ends by sign.
+*/
+template <typename Key>
+auto RadixKey(Key key)
+{
+    static_assert(std::is_arithmetic<Key>::value, "radix sort needs integer or floating point keys");
+
+    if constexpr (std::is_floating_point<Key>::value)
+    {
+        static_assert(sizeof(Key) == 4 || sizeof(Key) == 8, "radix sort supports 32 and 64 bit floating point keys");
+        typedef std::conditional_t<sizeof(Key) == 4, std::uint32_t, std::uint64_t> bits_type;
+        const bits_type signBit = bits_type(1) << (sizeof(bits_type) * 8 - 1);
+        bits_type bits;
+        std::memcpy(&bits, &key, sizeof(bits));
+        return static_cast<bits_type>((bits & signBit) ? ~bits : (bits | signBit));
+    }
+    else if constexpr (std::is_signed<Key>::value)
+    {
+        typedef std::make_unsigned_t<Key> bits_type;
+        const bits_type signBit = bits_type(1) << (sizeof(bits_type) * 8 - 1);
+        return static_cast<bits_type>(static_cast<bits_type>(key) ^ signBit);
+    }
+    else
+    {
+        return key;
+    }
+}
+
+/*
+Stable parallel LSD radix sort of [first, last) by keyOf(element), 8 bits per pass
+
+Every pass has each thread count the digits of its own contiguous block, a
+digit-major prefix sum over the per-block histograms gives every block its
+own output offsets, and then every block scatters stably into the other
+buffer. Passes where all elements share the digit are skipped.
+
+keyOf must return an integer or a 32/64 bit float, which makes sorting pairs
+or records by one field a one-liner. value_type must be default constructible.
+*/
+template <typename RandomIt, typename KeyOf>
+void parallel_radix_sort(thread_pool& pool, RandomIt first, RandomIt last, KeyOf keyOf,
+    const stop_token& token = stop_token())
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+    typedef decltype(RadixKey(keyOf(*first))) radix_type;
+    const unsigned int DigitBits = 8;
+    const std::size_t NumDigits = std::size_t(1) << DigitBits;
+    const unsigned int NumPasses = sizeof(radix_type) * 8 / DigitBits;
+
+    const auto n = static_cast<std::size_t>(last - first);
+    if (n < RadixSortCutoff)
+    {
+        token.ThrowIfStopRequested();
+        std::stable_sort(first, last, [&](const value_type& a, const value_type& b)
+        {
+            return RadixKey(keyOf(a)) < RadixKey(keyOf(b));
+        });
+        return;
+    }
+
+    const auto numBlocks = static_cast<std::size_t>(pool.Size()) + 1;
+    std::vector<std::array<std::size_t, NumDigits>> histograms(numBlocks);
+    std::vector<value_type> buffer(n);
+
+    // the passes ping-pong between the input and the buffer
+    auto inBuffer = false;
+
+    auto blockBounds = [&](std::size_t block)
+    {
+        return SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+    };
+
+    for (auto pass = 0u; pass < NumPasses; ++pass)
+    {
+        const auto shift = pass * DigitBits;
+        auto digitOf = [&](const value_type& v)
+        {
+            return static_cast<std::size_t>((RadixKey(keyOf(v)) >> shift) & (NumDigits - 1));
+        };
+
+        auto countBlocks = [&](std::size_t blockFirst, std::size_t blockLast, auto source)
+        {
+            for (auto block = blockFirst; block < blockLast; ++block)
+            {
+                auto& histogram = histograms[block];
+                histogram.fill(0);
+                const auto bounds = blockBounds(block);
+                for (auto i = bounds.first; i < bounds.second; ++i)
+                {
+                    ++histogram[digitOf(source[i])];
+                }
+            }
+        };
+        if (inBuffer)
+        {
+            parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1),
+                [&](std::size_t b, std::size_t e) { countBlocks(b, e, buffer.begin()); }, token);
+        }
+        else
+        {
+            parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1),
+                [&](std::size_t b, std::size_t e) { countBlocks(b, e, first); }, token);
+        }
+
+        // digit-major exclusive prefix sum, histograms become write offsets
+        auto offset = std::size_t(0);
+        auto skip = false;
+        for (auto digit = 0u; digit < NumDigits && !skip; ++digit)
+        {
+            auto digitTotal = std::size_t(0);
+            for (auto block = 0u; block < numBlocks; ++block)
+            {
+                digitTotal += histograms[block][digit];
+            }
+            skip = (digitTotal == n);
+            for (auto block = 0u; block < numBlocks; ++block)
+            {
+                const auto count = histograms[block][digit];
+                histograms[block][digit] = offset;
+                offset += count;
+            }
+        }
+        if (skip)
+        {
+            continue;
+        }
+
+        auto scatterBlocks = [&](std::size_t blockFirst, std::size_t blockLast, auto source, auto target)
+        {
+            for (auto block = blockFirst; block < blockLast; ++block)
+            {
+                auto& offsets = histograms[block];
+                const auto bounds = blockBounds(block);
+                for (auto i = bounds.first; i < bounds.second; ++i)
+                {
+                    target[offsets[digitOf(source[i])]++] = std::move(source[i]);
+                }
+            }
+        };
+        if (inBuffer)
+        {
+            parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1),
+                [&](std::size_t b, std::size_t e) { scatterBlocks(b, e, buffer.begin(), first); }, token);
+        }
+        else
+        {
+            parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1),
+                [&](std::size_t b, std::size_t e) { scatterBlocks(b, e, first, buffer.begin()); }, token);
+        }
+        inBuffer = !inBuffer;
+    }
+
+    if (inBuffer)
+    {
+        parallel_for(pool, std::size_t(0), n, [&](std::size_t chunkFirst, std::size_t chunkLast)
+        {
+            std::move(buffer.begin() + chunkFirst, buffer.begin() + chunkLast, first + chunkFirst);
+        }, token);
+    }
+}
+
+/*
+Sorts integer or floating point elements by value
+*/
+template <typename RandomIt>
+void parallel_radix_sort(thread_pool& pool, RandomIt first, RandomIt last, const stop_token& token = stop_token())
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+    parallel_radix_sort(pool, first, last, [](const value_type& v) { return v; }, token);
+}
+
+template <typename RandomIt, typename KeyOf>
+void parallel_radix_sort(RandomIt first, RandomIt last, KeyOf keyOf, const stop_token& token = stop_token())
+{
+    parallel_radix_sort(thread_pool::Default(), first, last, keyOf, token);
+}
+
+template <typename RandomIt>
+void parallel_radix_sort(RandomIt first, RandomIt last, const stop_token& token = stop_token())
+{
+    parallel_radix_sort(thread_pool::Default(), first, last, token);
+}
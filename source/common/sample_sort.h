@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "parallel_for.h"
+#include "quicksort.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Below this many elements the sort runs serially
+*/
+constexpr std::size_t SampleSortCutoff = 1 << 16;
+
+/*
+Parallel sample sort of [first, last)
+
+1. Oversample the input, sort the sample and pick evenly spaced splitters
+2. Every thread classifies a contiguous block against the splitters and
+   counts its elements per bucket
+3. A prefix sum over (bucket, block) gives every block its own place in every
+   bucket, so the scatter into a buffer needs no synchronization
+4. Buckets are sorted independently and moved back
+
+Equal splitters are merged and every remaining splitter gets its own
+equality bucket, which needs no sorting, so heavy duplicates do not end up
+as one oversized bucket. The sort is not stable, and once cancelled the
+contents of [first, last) are unspecified.
+value_type must be default constructible (the buffer is a std::vector).
+*/
+template <typename RandomIt, typename Compare>
+void parallel_sample_sort(thread_pool& pool, RandomIt first, RandomIt last, Compare comp,
+    const stop_token& token = stop_token())
+{
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+    typedef std::uint16_t bucket_index;
+
+    const auto n = static_cast<std::size_t>(last - first);
+    const auto numThreads = static_cast<std::size_t>(pool.Size()) + 1;
+    if (n < SampleSortCutoff || numThreads == 1)
+    {
+        token.ThrowIfStopRequested();
+        IntroSort(first, last, comp, token);
+        return;
+    }
+
+    // a few buckets per thread so uneven buckets still balance out
+    const std::size_t Oversampling = 32;
+    const auto numSplitters = std::min<std::size_t>(4 * numThreads, 1 << 14) - 1;
+
+    std::vector<value_type> splitters;
+    {
+        std::vector<value_type> sample;
+        sample.reserve((numSplitters + 1) * Oversampling);
+        std::mt19937_64 gen(n);
+        std::uniform_int_distribution<std::size_t> pick(0, n - 1);
+        for (auto i = 0u; i < (numSplitters + 1) * Oversampling; ++i)
+        {
+            sample.push_back(first[pick(gen)]);
+        }
+        std::sort(sample.begin(), sample.end(), comp);
+
+        splitters.reserve(numSplitters);
+        for (auto i = 1u; i <= numSplitters; ++i)
+        {
+            const auto& candidate = sample[i * Oversampling];
+            if (splitters.empty() || comp(splitters.back(), candidate))
+            {
+                splitters.push_back(candidate);
+            }
+        }
+    }
+
+    // bucket 2i holds what lies between splitters i - 1 and i, bucket 2i + 1
+    // what is equal to splitter i
+    const auto numBuckets = 2 * splitters.size() + 1;
+    auto classify = [&](const value_type& v) -> bucket_index
+    {
+        const auto i = static_cast<std::size_t>(std::lower_bound(splitters.begin(), splitters.end(), v, comp) - splitters.begin());
+        if (i < splitters.size() && !comp(v, splitters[i]))
+        {
+            return static_cast<bucket_index>(2 * i + 1);
+        }
+        return static_cast<bucket_index>(2 * i);
+    };
+
+    const auto numBlocks = numThreads;
+    std::vector<bucket_index> oracle(n);
+    std::vector<std::size_t> counts(numBlocks * numBuckets, 0);
+    parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+            auto blockCounts = &counts[block * numBuckets];
+            for (auto i = bounds.first; i < bounds.second; ++i)
+            {
+                oracle[i] = classify(first[i]);
+                ++blockCounts[oracle[i]];
+            }
+        }
+    }, token);
+
+    // bucket-major exclusive prefix sum, counts becomes each block's write offset
+    std::vector<std::size_t> bucketStarts(numBuckets + 1);
+    auto offset = std::size_t(0);
+    for (auto bucket = 0u; bucket < numBuckets; ++bucket)
+    {
+        bucketStarts[bucket] = offset;
+        for (auto block = 0u; block < numBlocks; ++block)
+        {
+            const auto count = counts[block * numBuckets + bucket];
+            counts[block * numBuckets + bucket] = offset;
+            offset += count;
+        }
+    }
+    bucketStarts[numBuckets] = offset;
+
+    std::vector<value_type> buffer(n);
+    parallel_for(pool, std::size_t(0), numBlocks, std::size_t(1), [&](std::size_t blockFirst, std::size_t blockLast)
+    {
+        for (auto block = blockFirst; block < blockLast; ++block)
+        {
+            const auto bounds = SlabBounds(std::size_t(0), n, static_cast<unsigned int>(block), static_cast<unsigned int>(numBlocks));
+            auto blockOffsets = &counts[block * numBuckets];
+            for (auto i = bounds.first; i < bounds.second; ++i)
+            {
+                buffer[blockOffsets[oracle[i]]++] = std::move(first[i]);
+            }
+        }
+    }, token);
+
+    // largest buckets get claimed first by going through them in size order
+    std::vector<std::size_t> order(numBuckets);
+    for (auto bucket = 0u; bucket < numBuckets; ++bucket)
+    {
+        order[bucket] = bucket;
+    }
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+    {
+        return bucketStarts[a + 1] - bucketStarts[a] > bucketStarts[b + 1] - bucketStarts[b];
+    });
+
+    parallel_for(pool, std::size_t(0), numBuckets, std::size_t(1), [&](std::size_t orderFirst, std::size_t orderLast)
+    {
+        for (auto i = orderFirst; i < orderLast; ++i)
+        {
+            const auto bucket = order[i];
+            const auto bucketFirst = buffer.begin() + bucketStarts[bucket];
+            const auto bucketLast = buffer.begin() + bucketStarts[bucket + 1];
+            if (bucket % 2 == 0)
+            {
+                IntroSort(bucketFirst, bucketLast, comp, token);
+            }
+            std::move(bucketFirst, bucketLast, first + bucketStarts[bucket]);
+        }
+    }, token);
+}
+
+template <typename RandomIt>
+void parallel_sample_sort(thread_pool& pool, RandomIt first, RandomIt last)
+{
+    parallel_sample_sort(pool, first, last, std::less<>());
+}
+
+template <typename RandomIt, typename Compare>
+void parallel_sample_sort(RandomIt first, RandomIt last, Compare comp, const stop_token& token = stop_token())
+{
+    parallel_sample_sort(thread_pool::Default(), first, last, comp, token);
+}
+
+template <typename RandomIt>
+void parallel_sample_sort(RandomIt first, RandomIt last)
+{
+    parallel_sample_sort(thread_pool::Default(), first, last, std::less<>());
+}
@@ -0,0 +1,23 @@
+#include "sharded_counter.h"
+#include "thread_pool.h"
+
+namespace
+{
+    std::atomic<unsigned int> nextShardHint(0);
+}
+
+unsigned int CurrentThreadShardHint()
+{
+    static thread_local const unsigned int hint = nextShardHint++;
+    return hint;
+}
+
+unsigned int DefaultShardCount()
+{
+    auto count = 1u;
+    while (count < GetHardwareThreadCount())
+    {
+        count <<= 1;
+    }
+    return count;
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*
+Scalable counters and reductions
+
+A single shared atomic turns every update into a cache line transfer between
+cores. These types give each thread its own cache line (shard) to update and
+only combine the shards when the value is read. Updates stay atomic so it is
+still correct when more threads than shards share one, it just gets slower.
+
+Reads walk all shards and are not a snapshot: updates that race with a read
+may or may not be included.
+*/
+
+constexpr std::size_t ShardCacheLineSize = 64;
+
+/*
+Shard the calling thread should update: threads are numbered in the order
+they first ask, so the workers of a pool end up on distinct shards
+*/
+unsigned int CurrentThreadShardHint();
+
+/*
+Number of shards used by default, the hardware thread count rounded up to a power of 2
+*/
+unsigned int DefaultShardCount();
+
+/*
+Combines per-thread partial results with Op, an associative and commutative
+binary operation, and identity as the starting value of every shard
+*/
+template <typename T, typename Op>
+class sharded_reducer
+{
+    static_assert(std::is_trivially_copyable<T>::value, "sharded_reducer needs a trivially copyable T");
+
+private:
+    struct alignas(ShardCacheLineSize) shard
+    {
+        std::atomic<T> value;
+    };
+
+    std::unique_ptr<shard[]> _shards;
+    unsigned int _mask;
+    T _identity;
+    Op _op;
+
+protected:
+    std::atomic<T>& LocalShard()
+    {
+        return _shards[CurrentThreadShardHint() & _mask].value;
+    }
+
+public:
+    explicit sharded_reducer(T identity, Op op = Op(), unsigned int numShards = DefaultShardCount()) :
+        _mask(0), _identity(identity), _op(op)
+    {
+        auto count = 1u;
+        while (count < numShards)
+        {
+            count <<= 1;
+        }
+        _shards.reset(new shard[count]);
+        _mask = count - 1;
+        Reset();
+    }
+
+    sharded_reducer(const sharded_reducer&) = delete;
+    sharded_reducer& operator=(const sharded_reducer&) = delete;
+
+    /*
+    Fold value into the calling thread's shard
+    */
+    void Update(T value)
+    {
+        auto& local = LocalShard();
+        auto current = local.load(std::memory_order_relaxed);
+        auto combined = _op(current, value);
+        // the shard is normally only written by this thread, the loop only
+        // repeats when another thread hashed onto the same shard
+        while (combined != current && !local.compare_exchange_weak(current, combined, std::memory_order_relaxed))
+        {
+            combined = _op(current, value);
+        }
+    }
+
+    T Value() const
+    {
+        auto result = _identity;
+        for (auto i = 0u; i <= _mask; ++i)
+        {
+            result = _op(result, _shards[i].value.load(std::memory_order_relaxed));
+        }
+        return result;
+    }
+
+    /*
+    Not safe to call while other threads update
+    */
+    void Reset()
+    {
+        for (auto i = 0u; i <= _mask; ++i)
+        {
+            _shards[i].value.store(_identity, std::memory_order_relaxed);
+        }
+    }
+
+    unsigned int NumShards() const
+    {
+        return _mask + 1;
+    }
+};
+
+template <typename T>
+struct min_op
+{
+    T operator()(const T& a, const T& b) const
+    {
+        return (b < a) ? b : a;
+    }
+};
+
+template <typename T>
+struct max_op
+{
+    T operator()(const T& a, const T& b) const
+    {
+        return (a < b) ? b : a;
+    }
+};
+
+template <typename T>
+class sharded_counter : public sharded_reducer<T, std::plus<T>>
+{
+public:
+    explicit sharded_counter(unsigned int numShards = DefaultShardCount()) :
+        sharded_reducer<T, std::plus<T>>(T(), std::plus<T>(), numShards) {}
+
+    void Add(T value)
+    {
+        if constexpr (std::is_integral<T>::value)
+        {
+            this->LocalShard().fetch_add(value, std::memory_order_relaxed);
+        }
+        else
+        {
+            this->Update(value);
+        }
+    }
+
+    void Increment()
+    {
+        Add(T(1));
+    }
+};
+
+template <typename T>
+class sharded_min : public sharded_reducer<T, min_op<T>>
+{
+public:
+    explicit sharded_min(unsigned int numShards = DefaultShardCount()) :
+        sharded_reducer<T, min_op<T>>(std::numeric_limits<T>::max(), min_op<T>(), numShards) {}
+};
+
+template <typename T>
+class sharded_max : public sharded_reducer<T, max_op<T>>
+{
+public:
+    explicit sharded_max(unsigned int numShards = DefaultShardCount()) :
+        sharded_reducer<T, max_op<T>>(std::numeric_limits<T>::lowest(), max_op<T>(), numShards) {}
+};
+
+/*
+Fixed number of bins counted per shard, each shard's bins start on their own cache line
+*/
+class sharded_histogram
+{
+private:
+    static constexpr std::size_t BinsPerLine = ShardCacheLineSize / sizeof(std::atomic<std::uint64_t>);
+
+    struct alignas(ShardCacheLineSize) line
+    {
+        std::atomic<std::uint64_t> bins[BinsPerLine];
+    };
+
+    std::unique_ptr<line[]> _lines;
+    std::size_t _numBins;
+    std::size_t _linesPerShard;
+    unsigned int _mask;
+
+    std::atomic<std::uint64_t>& Bin(unsigned int shard, std::size_t bin)
+    {
+        return _lines[shard * _linesPerShard + bin / BinsPerLine].bins[bin % BinsPerLine];
+    }
+
+    const std::atomic<std::uint64_t>& Bin(unsigned int shard, std::size_t bin) const
+    {
+        return _lines[shard * _linesPerShard + bin / BinsPerLine].bins[bin % BinsPerLine];
+    }
+
+public:
+    explicit sharded_histogram(std::size_t numBins, unsigned int numShards = DefaultShardCount()) :
+        _numBins(numBins), _linesPerShard((numBins + BinsPerLine - 1) / BinsPerLine), _mask(0)
+    {
+        auto count = 1u;
+        while (count < numShards)
+        {
+            count <<= 1;
+        }
+        _lines.reset(new line[count * _linesPerShard]);
+        _mask = count - 1;
+        Reset();
+    }
+
+    sharded_histogram(const sharded_histogram&) = delete;
+    sharded_histogram& operator=(const sharded_histogram&) = delete;
+
+    void Add(std::size_t bin, std::uint64_t count = 1)
+    {
+        if (bin >= _numBins)
+        {
+            throw std::out_of_range("sharded_histogram::Add()");
+        }
+        Bin(CurrentThreadShardHint() & _mask, bin).fetch_add(count, std::memory_order_relaxed);
+    }
+
+    std::vector<std::uint64_t> Counts() const
+    {
+        std::vector<std::uint64_t> counts(_numBins, 0);
+        for (auto shard = 0u; shard <= _mask; ++shard)
+        {
+            for (auto bin = 0u; bin < _numBins; ++bin)
+            {
+                counts[bin] += Bin(shard, bin).load(std::memory_order_relaxed);
+            }
+        }
+        return counts;
+    }
+
+    /*
+    Not safe to call while other threads add
+    */
+    void Reset()
+    {
+        for (auto i = 0u; i < (_mask + 1) * _linesPerShard; ++i)
+        {
+            for (auto& bin : _lines[i].bins)
+            {
+                bin.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::size_t NumBins() const
+    {
+        return _numBins;
+    }
+};
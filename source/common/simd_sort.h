@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+SIMD sorting networks and merge kernel for int and float keys
+
+Quicksort on short ranges is bound by mispredicted branches, a sorting
+network has none: every compare-exchange is a min and a max over all lanes.
+With AVX2 (/arch:AVX2, -mavx2) one register holds 8 keys and
+- Sort8 sorts them with a 6 stage bitonic network
+- Merge16 merges two sorted registers into 16 sorted keys
+- SimdMerge merges two sorted arrays 8 keys at a time
+- SimdSortSmall sorts up to SimdSortMaxSize keys: 8 sorted registers, then
+  merged pairwise
+Without AVX2 the same functions fall back to std::sort and std::merge.
+
+IntroSortLoop and MultiwayMerge switch to these by themselves when the key is
+int or float, the comparator is std::less and the iterators are pointers or
+std::vector iterators (IsSimdSortable). Float keys must not be NaN; -0.0 and
++0.0 compare equal and may come out in either order, but both are kept.
+*/
+
+/*
+Ranges this short are finished with SimdSortSmall instead of an insertion sort
+*/
+constexpr std::size_t SimdSortMaxSize = 64;
+
+template <typename RandomIt, typename Compare>
+constexpr bool IsSimdSortable()
+{
+#if defined(__AVX2__)
+    typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+    return (std::is_same<value_type, int>::value || std::is_same<value_type, float>::value)
+        && (std::is_same<Compare, std::less<>>::value || std::is_same<Compare, std::less<value_type>>::value)
+        && (std::is_same<RandomIt, value_type*>::value || std::is_same<RandomIt, const value_type*>::value
+            || std::is_same<RandomIt, typename std::vector<value_type>::iterator>::value
+            || std::is_same<RandomIt, typename std::vector<value_type>::const_iterator>::value);
+#else
+    return false;
+#endif
+}
+
+#if defined(__AVX2__)
+
+/*
+8 keys in one AVX2 register
+
+Min and Max return their first argument for equal keys. A compare-exchange
+has to hand each of two equal keys to a different side, and for floats equal
+is not identical: _mm256_min_ps and _mm256_max_ps both return the second
+operand for -0.0 and +0.0, which would write the same zero twice.
+*/
+template <typename T>
+struct simd_lanes;
+
+template <>
+struct simd_lanes<int>
+{
+    typedef __m256i reg;
+
+    static reg Load(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static void Store(int* p, reg v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    static reg Min(reg a, reg b) { return _mm256_min_epi32(a, b); }
+    static reg Max(reg a, reg b) { return _mm256_max_epi32(a, b); }
+    static reg Permute(reg v, __m256i index) { return _mm256_permutevar8x32_epi32(v, index); }
+    template <int Mask>
+    static reg Blend(reg a, reg b) { return _mm256_blend_epi32(a, b, Mask); }
+    static int Sentinel() { return std::numeric_limits<int>::max(); }
+};
+
+template <>
+struct simd_lanes<float>
+{
+    typedef __m256 reg;
+
+    static reg Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+    static reg Min(reg a, reg b) { return _mm256_blendv_ps(a, b, _mm256_cmp_ps(b, a, _CMP_LT_OQ)); }
+    static reg Max(reg a, reg b) { return _mm256_blendv_ps(a, b, _mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+    static reg Permute(reg v, __m256i index) { return _mm256_permutevar8x32_ps(v, index); }
+    template <int Mask>
+    static reg Blend(reg a, reg b) { return _mm256_blend_ps(a, b, Mask); }
+    static float Sentinel() { return std::numeric_limits<float>::infinity(); }
+};
+
+/*
+Lanes that keep the larger key of their pair in the bitonic stage with block
+size k and distance j: the upper lane in ascending blocks, the lower one in
+descending blocks
+*/
+constexpr int BitonicMaxLanes(int k, int j)
+{
+    auto mask = 0;
+    for (auto lane = 0; lane < 8; ++lane)
+    {
+        const auto ascending = (lane & k) == 0;
+        const auto upper = (lane & j) != 0;
+        if (ascending == upper)
+        {
+            mask |= 1 << lane;
+        }
+    }
+    return mask;
+}
+
+template <typename T, int K, int J>
+typename simd_lanes<T>::reg BitonicStage(typename simd_lanes<T>::reg v)
+{
+    typedef simd_lanes<T> lanes;
+    const auto partner = lanes::Permute(v, _mm256_setr_epi32(0 ^ J, 1 ^ J, 2 ^ J, 3 ^ J, 4 ^ J, 5 ^ J, 6 ^ J, 7 ^ J));
+    // both lanes of a pair keep their own key when the two are equal
+    return lanes::template Blend<BitonicMaxLanes(K, J)>(lanes::Min(v, partner), lanes::Max(v, partner));
+}
+
+/*
+Sorts a bitonic register ascending
+*/
+template <typename T>
+typename simd_lanes<T>::reg BitonicMerge8(typename simd_lanes<T>::reg v)
+{
+    v = BitonicStage<T, 8, 4>(v);
+    v = BitonicStage<T, 8, 2>(v);
+    return BitonicStage<T, 8, 1>(v);
+}
+
+template <typename T>
+typename simd_lanes<T>::reg Sort8(typename simd_lanes<T>::reg v)
+{
+    v = BitonicStage<T, 2, 1>(v);
+    v = BitonicStage<T, 4, 2>(v);
+    v = BitonicStage<T, 4, 1>(v);
+    return BitonicMerge8<T>(v);
+}
+
+/*
+Merges two sorted registers, lo gets the 8 smallest keys and hi the 8 largest, both sorted
+*/
+template <typename T>
+void Merge16(typename simd_lanes<T>::reg a, typename simd_lanes<T>::reg b, typename simd_lanes<T>::reg& lo,
+    typename simd_lanes<T>::reg& hi)
+{
+    typedef simd_lanes<T> lanes;
+
+    // a followed by b reversed is bitonic, one min/max splits it into two bitonic halves
+    b = lanes::Permute(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    // of two equal keys lo gets the one from a and hi the one from b
+    lo = BitonicMerge8<T>(lanes::Min(a, b));
+    hi = BitonicMerge8<T>(lanes::Max(b, a));
+}
+
+/*
+Merges the sorted arrays a and b into out, which must not overlap them
+
+Keeps the 8 largest keys seen so far in a register and loads the next 8 from
+whichever input has the smaller head; the 8 smallest of the 16 are final. Only
+the last few keys go through a scalar merge.
+*/
+template <typename T>
+void SimdMerge(const T* a, std::size_t sizeA, const T* b, std::size_t sizeB, T* out)
+{
+    typedef simd_lanes<T> lanes;
+
+    const auto aLast = a + sizeA;
+    const auto bLast = b + sizeB;
+    auto takeA = [&] { return b == bLast || (a != aLast && !(*b < *a)); };
+
+    const auto firstFromA = takeA();
+    auto& first = firstFromA ? a : b;
+    if ((firstFromA ? aLast : bLast) - first < 8)
+    {
+        std::merge(a, aLast, b, bLast, out);
+        return;
+    }
+    auto kept = lanes::Load(first);
+    first += 8;
+
+    while (a != aLast || b != bLast)
+    {
+        const auto fromA = takeA();
+        auto& next = fromA ? a : b;
+        if ((fromA ? aLast : bLast) - next < 8)
+        {
+            break;
+        }
+
+        typename lanes::reg lo;
+        Merge16<T>(kept, lanes::Load(next), lo, kept);
+        next += 8;
+        lanes::Store(out, lo);
+        out += 8;
+    }
+
+    // whatever is left in the inputs is not less than anything written so far;
+    // at least one input has fewer than 8 keys left, it is merged with the
+    // register first so the long one needs a single scalar pass
+    T kept8[8];
+    T tail[16];
+    lanes::Store(kept8, kept);
+    if (aLast - a < 8)
+    {
+        const auto tailLast = std::merge(kept8, kept8 + 8, a, aLast, tail);
+        std::merge(tail, tailLast, b, bLast, out);
+    }
+    else
+    {
+        const auto tailLast = std::merge(kept8, kept8 + 8, b, bLast, tail);
+        std::merge(tail, tailLast, a, aLast, out);
+    }
+}
+
+/*
+Sorts at most SimdSortMaxSize keys
+*/
+template <typename T>
+void SimdSortSmall(T* data, std::size_t size)
+{
+    typedef simd_lanes<T> lanes;
+
+    if (size <= 1)
+    {
+        return;
+    }
+
+    // padded to whole registers with keys that sort last
+    T buffer[2][SimdSortMaxSize];
+    const auto paddedSize = (size + 7) & ~std::size_t(7);
+    std::copy(data, data + size, buffer[0]);
+    std::fill(buffer[0] + size, buffer[0] + paddedSize, lanes::Sentinel());
+
+    for (auto i = std::size_t(0); i < paddedSize; i += 8)
+    {
+        lanes::Store(buffer[0] + i, Sort8<T>(lanes::Load(buffer[0] + i)));
+    }
+
+    auto source = 0;
+    for (auto width = std::size_t(8); width < paddedSize; width *= 2)
+    {
+        for (auto start = std::size_t(0); start < paddedSize; start += 2 * width)
+        {
+            const auto mid = std::min(start + width, paddedSize);
+            const auto end = std::min(start + 2 * width, paddedSize);
+            SimdMerge(buffer[source] + start, mid - start, buffer[source] + mid, end - mid, buffer[1 - source] + start);
+        }
+        source = 1 - source;
+    }
+
+    std::copy(buffer[source], buffer[source] + size, data);
+}
+
+#else
+
+template <typename T>
+void SimdMerge(const T* a, std::size_t sizeA, const T* b, std::size_t sizeB, T* out)
+{
+    std::merge(a, a + sizeA, b, b + sizeB, out);
+}
+
+template <typename T>
+void SimdSortSmall(T* data, std::size_t size)
+{
+    std::sort(data, data + size);
+}
+
+#endif
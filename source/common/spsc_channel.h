@@ -0,0 +1,363 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/*
+Bounded lock-free channel between exactly one producer thread and one consumer thread
+
+Items travel through a power-of-two ring. The producer only writes _tail and the
+consumer only writes _head, each on its own cache line, and each side keeps a
+cached copy of the other side's index so the shared line is only read when the
+ring looks full (or empty). Blocking calls spin for a while and then park on a
+condition variable; the other side only takes the mutex when someone is parked.
+*/
+template <typename T>
+class spsc_channel
+{
+public:
+    static constexpr std::size_t CacheLineSize = 64;
+    static constexpr unsigned int SpinCount = 1024;
+
+private:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type slot;
+
+    // read by both sides
+    std::unique_ptr<slot[]> _slots;
+    std::size_t _mask;
+
+    // producer side
+    alignas(CacheLineSize) std::atomic<std::size_t> _tail;
+    std::size_t _cachedHead;
+
+    // consumer side
+    alignas(CacheLineSize) std::atomic<std::size_t> _head;
+    std::size_t _cachedTail;
+
+    // parking, only touched when a side runs out of spins
+    alignas(CacheLineSize) std::atomic<bool> _closed;
+    std::atomic<bool> _producerParked;
+    std::atomic<bool> _consumerParked;
+    unsigned int _spinCount;
+    std::mutex _parkMutex;
+    std::condition_variable _parkCond;
+
+    static std::size_t RoundUpPowerOf2(std::size_t v)
+    {
+        std::size_t p = 1;
+        while (p < v)
+        {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    T* At(std::size_t index)
+    {
+        return reinterpret_cast<T*>(&_slots[index & _mask]);
+    }
+
+    static void Pause()
+    {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    void WakeIfParked(std::atomic<bool>& parked)
+    {
+        // pairs with the fence in Wait: either the waiter sees the new index
+        // when it checks before sleeping or we see its parked flag here
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked.load(std::memory_order_relaxed))
+        {
+            {
+                std::lock_guard<std::mutex> lock(_parkMutex);
+            }
+            _parkCond.notify_all();
+        }
+    }
+
+    template <typename Ready>
+    void Wait(std::atomic<bool>& parked, Ready ready)
+    {
+        for (auto i = 0u; i < _spinCount; ++i)
+        {
+            if (ready())
+            {
+                return;
+            }
+            Pause();
+        }
+
+        std::unique_lock<std::mutex> lock(_parkMutex);
+        parked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        _parkCond.wait(lock, ready);
+        parked.store(false, std::memory_order_relaxed);
+    }
+
+    std::size_t FreeSlots()
+    {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        auto free = Capacity() - (tail - _cachedHead);
+        if (free == 0)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            free = Capacity() - (tail - _cachedHead);
+        }
+        return free;
+    }
+
+    std::size_t AvailableItems()
+    {
+        const auto head = _head.load(std::memory_order_relaxed);
+        auto available = _cachedTail - head;
+        if (available == 0)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            available = _cachedTail - head;
+        }
+        return available;
+    }
+
+public:
+    explicit spsc_channel(std::size_t capacity) :
+        _mask(0), _tail(0), _cachedHead(0), _head(0), _cachedTail(0),
+        _closed(false), _producerParked(false), _consumerParked(false),
+        // spinning only helps if the other side is running on another core
+        _spinCount((std::thread::hardware_concurrency() > 1) ? SpinCount : 0)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("channel capacity must be greater than zero");
+        }
+        capacity = RoundUpPowerOf2(capacity);
+        _slots.reset(new slot[capacity]);
+        _mask = capacity - 1;
+    }
+
+    ~spsc_channel()
+    {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        for (auto i = _head.load(std::memory_order_relaxed); i != tail; ++i)
+        {
+            At(i)->~T();
+        }
+    }
+
+    spsc_channel(const spsc_channel&) = delete;
+    spsc_channel& operator=(const spsc_channel&) = delete;
+
+    std::size_t Capacity() const
+    {
+        return _mask + 1;
+    }
+
+    /*
+    Producer only
+    */
+    template <typename U>
+    bool TryPush(U&& value)
+    {
+        if (_closed.load(std::memory_order_relaxed) || FreeSlots() == 0)
+        {
+            return false;
+        }
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        new (At(tail)) T(std::forward<U>(value));
+        _tail.store(tail + 1, std::memory_order_release);
+        WakeIfParked(_consumerParked);
+        return true;
+    }
+
+    /*
+    Producer only
+    Moves as many items from [first, last) as currently fit with a single
+    publish, returns the iterator past the last item pushed
+    */
+    template <typename InputIt>
+    InputIt TryPushBatch(InputIt first, InputIt last)
+    {
+        if (_closed.load(std::memory_order_relaxed) || first == last)
+        {
+            return first;
+        }
+
+        auto free = FreeSlots();
+        if (free == 0)
+        {
+            return first;
+        }
+
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        auto i = tail;
+        for (; free > 0 && first != last; --free, ++first, ++i)
+        {
+            new (At(i)) T(std::move(*first));
+        }
+        _tail.store(i, std::memory_order_release);
+        WakeIfParked(_consumerParked);
+        return first;
+    }
+
+    /*
+    Producer only
+    Blocks while the channel is full, returns false if it was closed
+    */
+    template <typename U>
+    bool Push(U&& value)
+    {
+        while (!TryPush(std::forward<U>(value)))
+        {
+            Wait(_producerParked, [this] { return _closed.load() || FreeSlots() > 0; });
+            if (_closed.load())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+    Producer only
+    Blocks until all of [first, last) is pushed, returns false if the channel
+    was closed before that
+    */
+    template <typename InputIt>
+    bool PushBatch(InputIt first, InputIt last)
+    {
+        while (true)
+        {
+            first = TryPushBatch(first, last);
+            if (first == last)
+            {
+                return true;
+            }
+            Wait(_producerParked, [this] { return _closed.load() || FreeSlots() > 0; });
+            if (_closed.load())
+            {
+                return false;
+            }
+        }
+    }
+
+    /*
+    Consumer only
+    */
+    bool TryPop(T& value)
+    {
+        if (AvailableItems() == 0)
+        {
+            return false;
+        }
+        const auto head = _head.load(std::memory_order_relaxed);
+        auto item = At(head);
+        value = std::move(*item);
+        item->~T();
+        _head.store(head + 1, std::memory_order_release);
+        WakeIfParked(_producerParked);
+        return true;
+    }
+
+    /*
+    Consumer only
+    Moves up to maxCount available items to out with a single release of the
+    slots, returns the number of items popped
+    */
+    template <typename OutputIt>
+    std::size_t TryPopBatch(OutputIt out, std::size_t maxCount)
+    {
+        const auto count = std::min(AvailableItems(), maxCount);
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        const auto head = _head.load(std::memory_order_relaxed);
+        for (auto i = head; i != head + count; ++i, ++out)
+        {
+            auto item = At(i);
+            *out = std::move(*item);
+            item->~T();
+        }
+        _head.store(head + count, std::memory_order_release);
+        WakeIfParked(_producerParked);
+        return count;
+    }
+
+    /*
+    Consumer only
+    Blocks while the channel is empty, returns false once it is closed and drained
+    */
+    bool Pop(T& value)
+    {
+        while (!TryPop(value))
+        {
+            if (_closed.load() && AvailableItems() == 0)
+            {
+                return false;
+            }
+            Wait(_consumerParked, [this] { return _closed.load() || AvailableItems() > 0; });
+        }
+        return true;
+    }
+
+    /*
+    Consumer only
+    Blocks until at least one item is available, returns 0 once the channel is
+    closed and drained
+    */
+    template <typename OutputIt>
+    std::size_t PopBatch(OutputIt out, std::size_t maxCount)
+    {
+        while (true)
+        {
+            const auto count = TryPopBatch(out, maxCount);
+            if (count > 0 || maxCount == 0)
+            {
+                return count;
+            }
+            if (_closed.load() && AvailableItems() == 0)
+            {
+                return 0;
+            }
+            Wait(_consumerParked, [this] { return _closed.load() || AvailableItems() > 0; });
+        }
+    }
+
+    /*
+    Either side
+    Items already pushed can still be popped, further pushes fail
+    */
+    void Close()
+    {
+        _closed.store(true);
+        {
+            std::lock_guard<std::mutex> lock(_parkMutex);
+        }
+        _parkCond.notify_all();
+    }
+
+    bool IsClosed() const
+    {
+        return _closed.load();
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+/*
+Cooperative cancellation, modelled after C++20 std::stop_source / std::stop_token
+
+A stop_source owns the shared flag and hands out stop_tokens. Long-running work
+polls its token at convenient points (chunk boundaries) and gives up by
+throwing operation_cancelled. Nothing is ever interrupted preemptively.
+*/
+
+class operation_cancelled : public std::runtime_error
+{
+public:
+    operation_cancelled() : std::runtime_error("operation cancelled") {}
+};
+
+class stop_token
+{
+private:
+    std::shared_ptr<const std::atomic<bool>> _stopRequested;
+
+    friend class stop_source;
+    explicit stop_token(std::shared_ptr<const std::atomic<bool>> state) : _stopRequested(std::move(state)) {}
+
+public:
+    /*
+    A default constructed token is never stopped
+    */
+    stop_token() = default;
+
+    bool StopRequested() const
+    {
+        return _stopRequested && _stopRequested->load(std::memory_order_relaxed);
+    }
+
+    bool StopPossible() const
+    {
+        return _stopRequested != nullptr;
+    }
+
+    void ThrowIfStopRequested() const
+    {
+        if (StopRequested())
+        {
+            throw operation_cancelled();
+        }
+    }
+};
+
+class stop_source
+{
+private:
+    std::shared_ptr<std::atomic<bool>> _stopRequested;
+
+public:
+    stop_source() : _stopRequested(std::make_shared<std::atomic<bool>>(false)) {}
+
+    stop_token GetToken() const
+    {
+        return stop_token(_stopRequested);
+    }
+
+    /*
+    Returns true only for the call that actually made the request
+    */
+    bool RequestStop()
+    {
+        return !_stopRequested->exchange(true);
+    }
+
+    bool StopRequested() const
+    {
+        return _stopRequested->load(std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,256 @@
+#include "numa.h"
+#include "thread_pool.h"
+
+thread_local thread_pool* thread_pool::_currentPool = nullptr;
+thread_local unsigned int thread_pool::_currentWorkerIndex = 0;
+
+unsigned int GetHardwareThreadCount()
+{
+    const auto hardwareThreadCount = std::thread::hardware_concurrency();
+    return (hardwareThreadCount == 0) ? 1 : hardwareThreadCount;
+}
+
+thread_pool::thread_pool(unsigned int numThreads, bool pinWorkers) :
+    _done(false), _pendingTasks(0), _sleepingWorkers(0), _numNodes(1)
+{
+    if (numThreads == 0)
+    {
+        numThreads = 1;
+    }
+
+    _workers.reserve(numThreads);
+    for (auto i = 0u; i < numThreads; ++i)
+    {
+        _workers.emplace_back(new worker);
+    }
+
+    if (pinWorkers)
+    {
+        const auto topology = numa_topology::Discover();
+        const auto cpus = topology.Cpus();
+        if (!cpus.empty())
+        {
+            for (auto i = 0u; i < numThreads; ++i)
+            {
+                const auto cpu = cpus[i % cpus.size()];
+                _workers[i]->cpu = static_cast<int>(cpu);
+                _workers[i]->node = topology.NodeOfCpu(cpu);
+            }
+            _numNodes = static_cast<unsigned int>(topology.Nodes().size());
+        }
+    }
+
+    // steal from workers on the same node first, nearest index first
+    for (auto i = 0u; i < numThreads; ++i)
+    {
+        auto& victims = _workers[i]->victims;
+        for (auto sameNode : { true, false })
+        {
+            for (auto j = 1u; j < numThreads; ++j)
+            {
+                const auto victim = (i + j) % numThreads;
+                if ((_workers[victim]->node == _workers[i]->node) == sameNode)
+                {
+                    victims.push_back(victim);
+                }
+            }
+        }
+    }
+
+    try
+    {
+        _threads.reserve(numThreads);
+        for (auto i = 0u; i < numThreads; ++i)
+        {
+            _threads.emplace_back(&thread_pool::WorkerLoop, this, i);
+        }
+    }
+    catch (...)
+    {
+        WakeAllWorkers();
+        for (auto& t : _threads)
+        {
+            t.join();
+        }
+        throw;
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    WakeAllWorkers();
+    for (auto& t : _threads)
+    {
+        t.join();
+    }
+}
+
+thread_pool& thread_pool::Default()
+{
+    static thread_pool pool;
+    return pool;
+}
+
+void thread_pool::Post(function_wrapper task)
+{
+    if (_currentPool == this)
+    {
+        auto& queue = _workers[_currentWorkerIndex]->tasks;
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_front(std::move(task));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(_sharedQueue.mutex);
+        _sharedQueue.tasks.push_back(std::move(task));
+    }
+
+    ++_pendingTasks;
+    WakeWorker();
+}
+
+void thread_pool::PostTo(unsigned int workerIndex, function_wrapper task)
+{
+    auto& w = *_workers.at(workerIndex);
+    {
+        std::lock_guard<std::mutex> lock(w.affine.mutex);
+        w.affine.tasks.push_back(std::move(task));
+    }
+
+    ++w.pendingAffineTasks;
+
+    // there is no way to wake one particular worker
+    if (_sleepingWorkers.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+        }
+        _sleepCond.notify_all();
+    }
+}
+
+void thread_pool::WakeWorker()
+{
+    // _pendingTasks is incremented before _sleepingWorkers is read and a worker
+    // increments _sleepingWorkers before checking _pendingTasks, so at least one
+    // side sees the other
+    if (_sleepingWorkers.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+        }
+        _sleepCond.notify_one();
+    }
+}
+
+void thread_pool::WakeAllWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _done = true;
+    }
+    _sleepCond.notify_all();
+}
+
+bool thread_pool::TryPop(worker_queue& queue, function_wrapper& task, bool fromFront, std::atomic<std::size_t>& pending)
+{
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+    {
+        return false;
+    }
+
+    if (fromFront)
+    {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+    }
+    else
+    {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+    }
+    --pending;
+    return true;
+}
+
+bool thread_pool::TryGetTask(function_wrapper& task)
+{
+    if (_currentPool == this)
+    {
+        auto& self = *_workers[_currentWorkerIndex];
+        if (self.pendingAffineTasks.load() > 0 && TryPop(self.affine, task, true, self.pendingAffineTasks))
+        {
+            return true;
+        }
+
+        if (TryPop(self.tasks, task, true, _pendingTasks) || TryPop(_sharedQueue, task, true, _pendingTasks))
+        {
+            return true;
+        }
+
+        for (auto victim : self.victims)
+        {
+            if (TryPop(_workers[victim]->tasks, task, false, _pendingTasks))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    if (TryPop(_sharedQueue, task, true, _pendingTasks))
+    {
+        return true;
+    }
+
+    for (auto& victim : _workers)
+    {
+        if (TryPop(victim->tasks, task, false, _pendingTasks))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool thread_pool::RunPendingTask()
+{
+    function_wrapper task;
+    if (!TryGetTask(task))
+    {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void thread_pool::WorkerLoop(unsigned int index)
+{
+    _currentPool = this;
+    _currentWorkerIndex = index;
+
+    auto& self = *_workers[index];
+    if (self.cpu >= 0)
+    {
+        PinCurrentThreadToCpu(static_cast<unsigned int>(self.cpu));
+    }
+
+    while (!_done)
+    {
+        function_wrapper task;
+        if (TryGetTask(task))
+        {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        ++_sleepingWorkers;
+        _sleepCond.wait(lock, [this, &self]
+        {
+            return _done || _pendingTasks.load() > 0 || self.pendingAffineTasks.load() > 0;
+        });
+        --_sleepingWorkers;
+    }
+}
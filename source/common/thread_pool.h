@@ -0,0 +1,252 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "stop_token.h"
+
+/*
+Number of threads the hardware can run concurrently, never less than 1
+*/
+unsigned int GetHardwareThreadCount();
+
+/*
+Move-only type-erased callable
+std::function requires copyable targets so it cannot hold a std::packaged_task
+*/
+class function_wrapper
+{
+private:
+    struct impl_base
+    {
+        virtual ~impl_base() {}
+        virtual void Call() = 0;
+    };
+
+    template <typename F>
+    struct impl_type : impl_base
+    {
+        F f;
+        explicit impl_type(F&& f_) : f(std::move(f_)) {}
+        void Call() override { f(); }
+    };
+
+    std::unique_ptr<impl_base> _impl;
+
+public:
+    function_wrapper() = default;
+
+    template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, function_wrapper>::value>>
+    function_wrapper(F&& f) : _impl(new impl_type<std::decay_t<F>>(std::decay_t<F>(std::forward<F>(f)))) {}
+
+    function_wrapper(function_wrapper&& other) = default;
+    function_wrapper& operator=(function_wrapper&& other) = default;
+    function_wrapper(const function_wrapper&) = delete;
+    function_wrapper& operator=(const function_wrapper&) = delete;
+
+    void operator()()
+    {
+        _impl->Call();
+    }
+
+    explicit operator bool() const
+    {
+        return _impl != nullptr;
+    }
+};
+
+/*
+Fixed number of worker threads executing queued tasks
+
+Each worker owns a queue. Tasks posted from a worker go to the front of its own
+queue (LIFO, cache-warm), tasks posted from other threads go to a shared queue.
+Idle workers take from their own queue, then the shared queue, then steal from
+the back of the other workers' queues, trying workers on their own NUMA node
+before crossing to another node.
+
+Workers can be pinned to cores, in which case worker i runs on the i-th core
+of the topology listed node by node, so consecutive workers share a node.
+
+Workers sleep on a condition variable only when there is nothing left to run.
+Tasks still queued when the pool is destroyed are discarded, so their futures
+report std::future_errc::broken_promise.
+*/
+class thread_pool
+{
+private:
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<function_wrapper> tasks;
+    };
+
+    struct worker
+    {
+        worker_queue tasks; // can be stolen
+        worker_queue affine; // only ever run by this worker
+        std::atomic<std::size_t> pendingAffineTasks{ 0 };
+        int cpu = -1;
+        unsigned int node = 0;
+        std::vector<unsigned int> victims; // steal order, same node first
+    };
+
+    std::atomic<bool> _done;
+    std::atomic<std::size_t> _pendingTasks;
+    std::atomic<unsigned int> _sleepingWorkers;
+    std::mutex _sleepMutex;
+    std::condition_variable _sleepCond;
+
+    worker_queue _sharedQueue;
+    std::vector<std::unique_ptr<worker>> _workers;
+    std::vector<std::thread> _threads;
+    unsigned int _numNodes;
+
+    static thread_local thread_pool* _currentPool;
+    static thread_local unsigned int _currentWorkerIndex;
+
+    void WorkerLoop(unsigned int index);
+    bool TryPop(worker_queue& queue, function_wrapper& task, bool fromFront, std::atomic<std::size_t>& pending);
+    bool TryGetTask(function_wrapper& task);
+    void WakeWorker();
+    void WakeAllWorkers();
+
+public:
+    explicit thread_pool(unsigned int numThreads = GetHardwareThreadCount(), bool pinWorkers = false);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /*
+    Queue a task without a way to get its result
+    */
+    void Post(function_wrapper task);
+
+    /*
+    Queue a task and get a future for its result
+    */
+    template <typename Callable>
+    std::future<std::invoke_result_t<Callable>> Submit(Callable f)
+    {
+        typedef std::invoke_result_t<Callable> result_type;
+        std::packaged_task<result_type()> task(std::move(f));
+        auto result = task.get_future();
+        Post(function_wrapper(std::move(task)));
+        return result;
+    }
+
+    /*
+    Same as Submit(f) but the task is skipped if a stop is requested before it
+    starts, its future then holds operation_cancelled
+    */
+    template <typename Callable>
+    std::future<std::invoke_result_t<Callable>> Submit(Callable f, const stop_token& token)
+    {
+        return Submit([f = std::move(f), token]() mutable
+        {
+            token.ThrowIfStopRequested();
+            return f();
+        });
+    }
+
+    /*
+    Queue a task that only the given worker may run
+    */
+    void PostTo(unsigned int workerIndex, function_wrapper task);
+
+    template <typename Callable>
+    std::future<std::invoke_result_t<Callable>> SubmitTo(unsigned int workerIndex, Callable f)
+    {
+        typedef std::invoke_result_t<Callable> result_type;
+        std::packaged_task<result_type()> task(std::move(f));
+        auto result = task.get_future();
+        PostTo(workerIndex, function_wrapper(std::move(task)));
+        return result;
+    }
+
+    /*
+    Call body(workerIndex) once on every worker and wait for all of them
+    The first exception thrown by body is rethrown
+    */
+    template <typename Body>
+    void RunOnEachWorker(const Body& body)
+    {
+        std::vector<std::future<void>> done;
+        done.reserve(Size());
+        for (auto i = 0u; i < Size(); ++i)
+        {
+            done.push_back(SubmitTo(i, [&body, i] { body(i); }));
+        }
+        for (auto& f : done)
+        {
+            Wait(f);
+        }
+        for (auto& f : done)
+        {
+            f.get();
+        }
+    }
+
+    /*
+    Run one queued task on the calling thread
+    Returns false if there was nothing to run
+    */
+    bool RunPendingTask();
+
+    /*
+    Block until the future is ready, running queued tasks in the meantime
+    Use this instead of future::wait() inside a task, otherwise a pool whose
+    workers are all waiting on each other's subtasks deadlocks
+    */
+    template <typename T>
+    void Wait(const std::future<T>& f)
+    {
+        while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            if (!RunPendingTask())
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    unsigned int Size() const
+    {
+        return static_cast<unsigned int>(_threads.size());
+    }
+
+    /*
+    NUMA node the worker runs on, always 0 when workers are not pinned
+    */
+    unsigned int WorkerNode(unsigned int workerIndex) const
+    {
+        return _workers[workerIndex]->node;
+    }
+
+    unsigned int NumNodes() const
+    {
+        return _numNodes;
+    }
+
+    /*
+    True when called from one of this pool's workers
+    */
+    bool IsWorkerThread() const
+    {
+        return _currentPool == this;
+    }
+
+    /*
+    Process-wide pool with one worker per hardware thread
+    */
+    static thread_pool& Default();
+};
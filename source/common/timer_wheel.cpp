@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <limits>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "timer_wheel.h"
+
+namespace
+{
+    const std::uint64_t NoTick = std::numeric_limits<std::uint64_t>::max();
+
+    unsigned int CountTrailingZeros(std::uint64_t v)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, v);
+        return static_cast<unsigned int>(index);
+#else
+        return static_cast<unsigned int>(__builtin_ctzll(v));
+#endif
+    }
+
+    /*
+    Index of the first set bit in [begin, end) or end if there is none
+    */
+    unsigned int FindFirstSet(const std::uint64_t* words, unsigned int begin, unsigned int end)
+    {
+        while (begin < end)
+        {
+            const auto wordIndex = begin / 64;
+            auto word = words[wordIndex] >> (begin % 64);
+            if (word != 0)
+            {
+                const auto found = begin + CountTrailingZeros(word);
+                return (found < end) ? found : end;
+            }
+            begin = (wordIndex + 1) * 64;
+        }
+        return end;
+    }
+}
+
+timer_wheel::timer_wheel(std::uint64_t startTick) :
+    _currentTick(startTick), _count(0)
+{
+    std::fill(&_heads[0][0], &_heads[0][0] + NumLevels * NumSlots, None);
+    std::fill(&_occupied[0][0], &_occupied[0][0] + NumLevels * WordsPerLevel, 0ull);
+}
+
+void timer_wheel::Link(std::uint32_t index)
+{
+    auto& n = _nodes[index];
+    const auto delta = n.expiry - _currentTick;
+
+    unsigned int level = 0;
+    while (level < NumLevels - 1 && (delta >> (SlotBits * (level + 1))) != 0)
+    {
+        ++level;
+    }
+
+    const auto shift = SlotBits * level;
+    unsigned int slot;
+    if ((delta >> (SlotBits * NumLevels)) != 0)
+    {
+        // beyond the range of the wheel, park it in the farthest slot and
+        // re-link it when that slot cascades
+        slot = static_cast<unsigned int>(((_currentTick >> shift) + SlotMask) & SlotMask);
+    }
+    else
+    {
+        slot = static_cast<unsigned int>((n.expiry >> shift) & SlotMask);
+    }
+
+    n.level = static_cast<std::uint16_t>(level);
+    n.slot = static_cast<std::uint16_t>(slot);
+    n.prev = None;
+    n.next = _heads[level][slot];
+    if (n.next != None)
+    {
+        _nodes[n.next].prev = index;
+    }
+    _heads[level][slot] = index;
+    _occupied[level][slot / 64] |= 1ull << (slot % 64);
+}
+
+void timer_wheel::Unlink(std::uint32_t index)
+{
+    auto& n = _nodes[index];
+    if (n.prev != None)
+    {
+        _nodes[n.prev].next = n.next;
+    }
+    else
+    {
+        _heads[n.level][n.slot] = n.next;
+        if (n.next == None)
+        {
+            _occupied[n.level][n.slot / 64] &= ~(1ull << (n.slot % 64));
+        }
+    }
+
+    if (n.next != None)
+    {
+        _nodes[n.next].prev = n.prev;
+    }
+}
+
+void timer_wheel::Release(std::uint32_t index)
+{
+    auto& n = _nodes[index];
+    n.callback = function_wrapper();
+    n.active = false;
+    ++n.generation;
+    if (n.generation == 0)
+    {
+        n.generation = 1;
+    }
+    _freeNodes.push_back(index);
+}
+
+timer_id timer_wheel::Schedule(std::uint64_t expiryTick, function_wrapper callback)
+{
+    std::uint32_t index;
+    if (_freeNodes.empty())
+    {
+        index = static_cast<std::uint32_t>(_nodes.size());
+        _nodes.emplace_back();
+        _nodes[index].generation = 1;
+    }
+    else
+    {
+        index = _freeNodes.back();
+        _freeNodes.pop_back();
+    }
+
+    auto& n = _nodes[index];
+    n.callback = std::move(callback);
+    n.expiry = std::max(expiryTick, _currentTick + 1);
+    n.active = true;
+    Link(index);
+    ++_count;
+
+    return (static_cast<timer_id>(n.generation) << 32) | index;
+}
+
+bool timer_wheel::Cancel(timer_id id)
+{
+    const auto index = static_cast<std::uint32_t>(id & 0xFFFFFFFFu);
+    const auto generation = static_cast<std::uint32_t>(id >> 32);
+    if (index >= _nodes.size())
+    {
+        return false;
+    }
+
+    const auto& n = _nodes[index];
+    if (!n.active || n.generation != generation)
+    {
+        return false;
+    }
+
+    Unlink(index);
+    Release(index);
+    --_count;
+    return true;
+}
+
+void timer_wheel::Cascade()
+{
+    for (auto level = 1u; level < NumLevels; ++level)
+    {
+        const auto shift = SlotBits * level;
+        if ((_currentTick & ((1ull << shift) - 1)) != 0)
+        {
+            break;
+        }
+
+        // detach the whole slot first, entries beyond the wheel's range may
+        // be linked back into the same slot
+        const auto slot = static_cast<unsigned int>((_currentTick >> shift) & SlotMask);
+        auto index = _heads[level][slot];
+        _heads[level][slot] = None;
+        _occupied[level][slot / 64] &= ~(1ull << (slot % 64));
+
+        while (index != None)
+        {
+            const auto next = _nodes[index].next;
+            Link(index);
+            index = next;
+        }
+    }
+}
+
+void timer_wheel::CollectSlot(unsigned int slot, std::vector<function_wrapper>& expired)
+{
+    auto index = _heads[0][slot];
+    _heads[0][slot] = None;
+    _occupied[0][slot / 64] &= ~(1ull << (slot % 64));
+
+    while (index != None)
+    {
+        const auto next = _nodes[index].next;
+        expired.push_back(std::move(_nodes[index].callback));
+        Release(index);
+        --_count;
+        index = next;
+    }
+}
+
+std::uint64_t timer_wheel::NextWakeTick() const
+{
+    if (_count == 0)
+    {
+        return NoTick;
+    }
+
+    auto earliest = NoTick;
+    for (auto level = 0u; level < NumLevels; ++level)
+    {
+        const auto shift = SlotBits * level;
+        const auto current = _currentTick >> shift;
+        const auto slot = static_cast<unsigned int>(current & SlotMask);
+
+        // slots are used circularly, anything at or before the current slot
+        // belongs to the next rotation
+        std::uint64_t distance;
+        auto found = FindFirstSet(_occupied[level], slot + 1, NumSlots);
+        if (found != NumSlots)
+        {
+            distance = found - slot;
+        }
+        else
+        {
+            found = FindFirstSet(_occupied[level], 0, slot + 1);
+            if (found == slot + 1)
+            {
+                continue;
+            }
+            distance = found + NumSlots - slot;
+        }
+
+        earliest = std::min(earliest, (current + distance) << shift);
+    }
+    return earliest;
+}
+
+void timer_wheel::Advance(std::uint64_t tick, std::vector<function_wrapper>& expired)
+{
+    while (_currentTick < tick)
+    {
+        // jump straight to the next tick where something fires or cascades,
+        // empty slots in between are never visited
+        const auto next = NextWakeTick();
+        if (next > tick)
+        {
+            _currentTick = tick;
+            break;
+        }
+
+        _currentTick = next;
+        Cascade();
+        CollectSlot(static_cast<unsigned int>(_currentTick & SlotMask), expired);
+    }
+}
+
+timer_service::timer_service(thread_pool& executor, clock::duration resolution) :
+    _executor(executor),
+    _start(clock::now()),
+    _resolution((resolution.count() > 0) ? resolution : clock::duration(1)),
+    _wheel(0),
+    _wakeTick(NoTick),
+    _done(false)
+{
+    _driver = std::thread(&timer_service::DriverLoop, this);
+}
+
+timer_service::~timer_service()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+    }
+    _cond.notify_one();
+    _driver.join();
+}
+
+std::uint64_t timer_service::ToTick(clock::time_point when) const
+{
+    // round up so a timer never fires early
+    if (when <= _start)
+    {
+        return 0;
+    }
+    return static_cast<std::uint64_t>((when - _start + _resolution - clock::duration(1)) / _resolution);
+}
+
+timer_service::clock::time_point timer_service::ToTimePoint(std::uint64_t tick) const
+{
+    return _start + _resolution * static_cast<clock::rep>(tick);
+}
+
+timer_id timer_service::Schedule(clock::time_point when, function_wrapper callback)
+{
+    return ScheduleOnDriver(when, [this, callback = std::move(callback)]() mutable
+    {
+        _executor.Post(std::move(callback));
+    });
+}
+
+timer_id timer_service::ScheduleOnDriver(clock::time_point when, function_wrapper callback)
+{
+    const auto tick = ToTick(when);
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto id = _wheel.Schedule(tick, std::move(callback));
+    if (tick < _wakeTick)
+    {
+        _cond.notify_one();
+    }
+    return id;
+}
+
+bool timer_service::Cancel(timer_id id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _wheel.Cancel(id);
+}
+
+std::size_t timer_service::Pending() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _wheel.Size();
+}
+
+void timer_service::DriverLoop()
+{
+    std::vector<function_wrapper> expired;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_done)
+    {
+        // round down, only ticks that fully elapsed are processed
+        const auto nowTick = static_cast<std::uint64_t>((clock::now() - _start) / _resolution);
+        _wheel.Advance(nowTick, expired);
+
+        if (!expired.empty())
+        {
+            lock.unlock();
+            for (auto& callback : expired)
+            {
+                callback();
+            }
+            expired.clear();
+            lock.lock();
+            continue;
+        }
+
+        _wakeTick = _wheel.NextWakeTick();
+        if (_wakeTick == NoTick)
+        {
+            _cond.wait(lock);
+        }
+        else
+        {
+            _cond.wait_until(lock, ToTimePoint(_wakeTick));
+        }
+    }
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Handle returned when scheduling a timer, 0 is never a valid handle
+*/
+typedef std::uint64_t timer_id;
+
+/*
+Hierarchical timing wheel (Varghese & Lauck)
+
+4 levels of 256 slots. Level 0 covers the next 256 ticks one tick per slot,
+level 1 the next 256 * 256 ticks 256 ticks per slot, and so on. Timers further
+than 2^32 ticks away are clamped to the last slot.
+
+Each slot is an intrusive doubly-linked list of nodes stored in a slab, so
+Schedule and Cancel are O(1). Advance only visits occupied level 0 slots and
+cascades a higher level slot down once per 256 ticks of the level below it.
+
+Not thread-safe, see timer_service
+*/
+class timer_wheel
+{
+private:
+    static constexpr unsigned int NumLevels = 4;
+    static constexpr unsigned int SlotBits = 8;
+    static constexpr unsigned int NumSlots = 1u << SlotBits;
+    static constexpr unsigned int SlotMask = NumSlots - 1;
+    static constexpr unsigned int WordsPerLevel = NumSlots / 64;
+    static constexpr std::uint32_t None = 0xFFFFFFFFu;
+
+    struct node
+    {
+        function_wrapper callback;
+        std::uint64_t expiry;
+        std::uint32_t prev;
+        std::uint32_t next;
+        std::uint32_t generation;
+        std::uint16_t level;
+        std::uint16_t slot;
+        bool active;
+    };
+
+    std::vector<node> _nodes;
+    std::vector<std::uint32_t> _freeNodes;
+    std::uint32_t _heads[NumLevels][NumSlots];
+    std::uint64_t _occupied[NumLevels][WordsPerLevel];
+    std::uint64_t _currentTick;
+    std::size_t _count;
+
+    void Link(std::uint32_t index);
+    void Unlink(std::uint32_t index);
+    void Release(std::uint32_t index);
+    void Cascade();
+    void CollectSlot(unsigned int slot, std::vector<function_wrapper>& expired);
+    std::uint64_t NextOccupiedTick(std::uint64_t limit) const;
+
+public:
+    explicit timer_wheel(std::uint64_t startTick = 0);
+
+    timer_wheel(const timer_wheel&) = delete;
+    timer_wheel& operator=(const timer_wheel&) = delete;
+
+    /*
+    Add a timer firing at expiryTick, ticks in the past fire on the next Advance
+    */
+    timer_id Schedule(std::uint64_t expiryTick, function_wrapper callback);
+
+    /*
+    Remove a pending timer
+    Returns false if the timer already fired or was cancelled
+    */
+    bool Cancel(timer_id id);
+
+    /*
+    Move the wheel to tick and append the callbacks of all timers that expired
+    on the way, in expiry order
+    */
+    void Advance(std::uint64_t tick, std::vector<function_wrapper>& expired);
+
+    /*
+    Earliest tick worth advancing to: either the next occupied level 0 slot or
+    the next cascade. Returns UINT64_MAX when no timer is pending
+    */
+    std::uint64_t NextWakeTick() const;
+
+    std::uint64_t CurrentTick() const
+    {
+        return _currentTick;
+    }
+
+    std::size_t Size() const
+    {
+        return _count;
+    }
+
+    bool Empty() const
+    {
+        return _count == 0;
+    }
+};
+
+/*
+Thrown by the future of a task that missed its deadline
+*/
+class deadline_exceeded : public std::runtime_error
+{
+public:
+    deadline_exceeded() : std::runtime_error("deadline exceeded") {}
+};
+
+/*
+Thread-safe timer_wheel driven by a dedicated thread
+
+The driver thread only sleeps and advances the wheel, expired callbacks are
+posted to the executor so a slow callback does not delay other timers.
+Internal bookkeeping callbacks (deadlines) run on the driver thread itself so
+they still fire when every executor thread is busy.
+*/
+class timer_service
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+private:
+    thread_pool& _executor;
+    const clock::time_point _start;
+    const clock::duration _resolution;
+
+    timer_wheel _wheel;
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    std::uint64_t _wakeTick;
+    bool _done;
+    std::thread _driver;
+
+    timer_id Schedule(clock::time_point when, function_wrapper callback);
+    timer_id ScheduleOnDriver(clock::time_point when, function_wrapper callback);
+    std::uint64_t ToTick(clock::time_point when) const;
+    clock::time_point ToTimePoint(std::uint64_t tick) const;
+    void DriverLoop();
+
+    template <typename R, typename Callable>
+    static void SetPromiseResult(std::promise<R>& promise, Callable f)
+    {
+        promise.set_value(f());
+    }
+
+    template <typename Callable>
+    static void SetPromiseResult(std::promise<void>& promise, Callable f)
+    {
+        f();
+        promise.set_value();
+    }
+
+    template <typename Callable>
+    static auto InvokeWithToken(Callable& f, const stop_token& token)
+    {
+        if constexpr (std::is_invocable<Callable&, stop_token>::value)
+        {
+            return f(token);
+        }
+        else
+        {
+            return f();
+        }
+    }
+
+    template <typename Callable>
+    using deadline_result_t = typename std::conditional_t<std::is_invocable<Callable&, stop_token>::value,
+        std::invoke_result<Callable&, stop_token>, std::invoke_result<Callable&>>::type;
+
+public:
+    explicit timer_service(thread_pool& executor = thread_pool::Default(),
+        clock::duration resolution = std::chrono::milliseconds(1));
+    ~timer_service();
+
+    timer_service(const timer_service&) = delete;
+    timer_service& operator=(const timer_service&) = delete;
+
+    template <typename Callable>
+    timer_id ScheduleAt(clock::time_point when, Callable f)
+    {
+        return Schedule(when, function_wrapper(std::move(f)));
+    }
+
+    template <typename Callable>
+    timer_id ScheduleAfter(clock::duration delay, Callable f)
+    {
+        return ScheduleAt(clock::now() + delay, std::move(f));
+    }
+
+    /*
+    Returns false if the timer already fired or was cancelled
+    */
+    bool Cancel(timer_id id);
+
+    /*
+    Run f on the executor. If it has not finished by the deadline the returned
+    future becomes ready with deadline_exceeded instead of its result.
+    No thread blocks waiting for the deadline, the timer is cancelled as soon as
+    f completes. The timer_service must outlive the task.
+
+    If f accepts a stop_token, a stop is requested on it when the deadline
+    passes so abandoned work can give up early.
+    */
+    template <typename Callable>
+    std::future<deadline_result_t<Callable>> SubmitWithDeadline(Callable f, clock::time_point deadline)
+    {
+        typedef deadline_result_t<Callable> result_type;
+        struct deadline_state
+        {
+            std::promise<result_type> promise;
+            std::atomic<bool> settled{ false };
+            std::atomic<timer_id> timer{ 0 };
+            stop_source stop;
+        };
+
+        auto state = std::make_shared<deadline_state>();
+        auto result = state->promise.get_future();
+
+        state->timer = ScheduleOnDriver(deadline, [state]
+        {
+            state->stop.RequestStop();
+            if (!state->settled.exchange(true))
+            {
+                state->promise.set_exception(std::make_exception_ptr(deadline_exceeded()));
+            }
+        });
+
+        _executor.Post([this, state, f = std::move(f)]() mutable
+        {
+            if (state->settled)
+            {
+                return; // too late, don't bother starting
+            }
+
+            const auto token = state->stop.GetToken();
+            std::packaged_task<result_type()> task([&f, &token] { return InvokeWithToken(f, token); });
+            auto local = task.get_future();
+            task();
+
+            if (!state->settled.exchange(true))
+            {
+                Cancel(state->timer);
+                try
+                {
+                    SetPromiseResult(state->promise, [&local] { return local.get(); });
+                }
+                catch (...)
+                {
+                    state->promise.set_exception(std::current_exception());
+                }
+            }
+        });
+
+        return result;
+    }
+
+    template <typename Callable>
+    std::future<deadline_result_t<Callable>> SubmitWithTimeout(Callable f, clock::duration timeout)
+    {
+        return SubmitWithDeadline(std::move(f), clock::now() + timeout);
+    }
+
+    std::size_t Pending() const;
+};
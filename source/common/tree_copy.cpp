@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "parallel_for.h"
+#include "tree_copy.h"
+
+namespace fs = std::experimental::filesystem;
+
+namespace
+{
+    /*
+    Parallel listing of a tree, one pool task per directory
+    */
+    class tree_scan
+    {
+    private:
+        thread_pool& _pool;
+        const fs::path _root;
+        const stop_token& _token;
+
+        std::mutex _mutex;
+        tree_listing _listing;
+        std::exception_ptr _error;
+        std::atomic<bool> _failed{ false };
+        std::atomic<std::size_t> _pendingDirectories{ 1 };
+
+        void ScanDirectory(const fs::path& relative)
+        {
+            std::vector<fs::path> subdirectories;
+            tree_listing found;
+            try
+            {
+                if (!_failed && !_token.StopRequested())
+                {
+                    for (auto& entry : fs::directory_iterator(_root / relative))
+                    {
+                        const auto status = fs::symlink_status(entry.path());
+                        const auto path = relative / entry.path().filename();
+                        if (fs::is_symlink(status))
+                        {
+                            found.symlinks.push_back(path.string());
+                        }
+                        else if (fs::is_directory(status))
+                        {
+                            subdirectories.push_back(path);
+                            found.directories.push_back(path.string());
+                        }
+                        else if (fs::is_regular_file(status))
+                        {
+                            const auto size = static_cast<std::uint64_t>(fs::file_size(entry.path()));
+                            found.files.push_back({ path.string(), size });
+                            found.bytes += size;
+                        }
+                    }
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_error)
+                {
+                    _error = std::current_exception();
+                }
+                _failed = true;
+                subdirectories.clear();
+            }
+
+            // counted before this directory is done, so the count cannot reach 0 while subdirectories are queued
+            _pendingDirectories += subdirectories.size();
+            for (auto& subdirectory : subdirectories)
+            {
+                _pool.Post([this, subdirectory] { ScanDirectory(subdirectory); });
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto append = [](auto& to, auto& from) { to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end())); };
+                append(_listing.directories, found.directories);
+                append(_listing.files, found.files);
+                append(_listing.symlinks, found.symlinks);
+                _listing.bytes += found.bytes;
+            }
+
+            // nothing of this may be touched after the last directory is done, Run returns then
+            --_pendingDirectories;
+        }
+
+    public:
+        tree_scan(thread_pool& pool, const std::string& root, const stop_token& token)
+            : _pool(pool), _root(root), _token(token)
+        {
+        }
+
+        tree_listing Run()
+        {
+            _pool.Post([this] { ScanDirectory(fs::path()); });
+            while (_pendingDirectories != 0)
+            {
+                if (!_pool.RunPendingTask())
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            if (_error)
+            {
+                std::rethrow_exception(_error);
+            }
+            _token.ThrowIfStopRequested();
+
+            std::sort(_listing.directories.begin(), _listing.directories.end());
+            return std::move(_listing);
+        }
+    };
+
+    /*
+    Files dealt out to workers by size, largest first, with stealing from the
+    worker that has the most bytes left
+    */
+    class size_scheduler
+    {
+    private:
+        struct worker_files
+        {
+            std::mutex mutex;
+            std::deque<const tree_file*> files; // largest at the front
+            std::atomic<std::uint64_t> cost{ 0 };
+        };
+
+        std::vector<worker_files> _workers;
+
+        static std::uint64_t Cost(const tree_file& file)
+        {
+            return file.size + TreeCopyFileCost;
+        }
+
+        const tree_file* Take(worker_files& worker, bool largest)
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.files.empty())
+            {
+                return nullptr;
+            }
+            const auto file = largest ? worker.files.front() : worker.files.back();
+            if (largest)
+            {
+                worker.files.pop_front();
+            }
+            else
+            {
+                worker.files.pop_back();
+            }
+            worker.cost -= Cost(*file);
+            return file;
+        }
+
+    public:
+        size_scheduler(const std::vector<tree_file>& files, unsigned int numWorkers) : _workers(numWorkers)
+        {
+            std::vector<const tree_file*> bySize;
+            bySize.reserve(files.size());
+            for (auto& file : files)
+            {
+                bySize.push_back(&file);
+            }
+            std::sort(bySize.begin(), bySize.end(), [](const tree_file* a, const tree_file* b) { return a->size > b->size; });
+
+            // longest processing time first: every file goes to the worker with the least so far
+            typedef std::pair<std::uint64_t, unsigned int> load;
+            std::priority_queue<load, std::vector<load>, std::greater<load>> loads;
+            for (auto i = 0u; i < numWorkers; ++i)
+            {
+                loads.push({ 0, i });
+            }
+            for (auto file : bySize)
+            {
+                auto least = loads.top();
+                loads.pop();
+                _workers[least.second].files.push_back(file);
+                _workers[least.second].cost += Cost(*file);
+                least.first += Cost(*file);
+                loads.push(least);
+            }
+        }
+
+        /*
+        Next file for the worker, nullptr when all files have been handed out
+        */
+        const tree_file* Next(unsigned int worker)
+        {
+            if (auto file = Take(_workers[worker], true))
+            {
+                return file;
+            }
+
+            // the victim keeps its large files, it is working down from the front
+            for (;;)
+            {
+                auto victim = _workers.size();
+                auto victimCost = std::uint64_t(0);
+                for (auto i = std::size_t(0); i < _workers.size(); ++i)
+                {
+                    const auto cost = _workers[i].cost.load();
+                    if (cost > victimCost)
+                    {
+                        victim = i;
+                        victimCost = cost;
+                    }
+                }
+                if (victim == _workers.size())
+                {
+                    return nullptr;
+                }
+                if (auto file = Take(_workers[victim], false))
+                {
+                    return file;
+                }
+            }
+        }
+    };
+
+    /*
+    Modification time first: Windows cannot set the time of a file made read-only
+    */
+    void CopyMetadata(const fs::path& source, const fs::path& destination)
+    {
+        fs::last_write_time(destination, fs::last_write_time(source));
+        fs::permissions(destination, fs::status(source).permissions());
+    }
+
+    /*
+    A read-only destination from an earlier copy would refuse to be overwritten,
+    or a directory to have entries added
+    */
+    void MakeWritable(const fs::path& path, const fs::file_status& status)
+    {
+        if ((status.permissions() & fs::perms::owner_write) == fs::perms::none)
+        {
+            fs::permissions(path, status.permissions() | fs::perms::owner_write);
+        }
+    }
+
+    struct manifest_entry
+    {
+        std::uint32_t checksum = 0;
+        std::uint64_t size = 0;
+        bool valid = false;
+    };
+
+    typedef std::unordered_map<std::string, manifest_entry> manifest;
+
+    /*
+    One line per file: checksum (8 hex digits), size, relative path
+    */
+    manifest ReadManifest(const fs::path& path)
+    {
+        manifest entries;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            manifest_entry entry;
+            std::string relative;
+            if (fields >> std::hex >> entry.checksum >> std::dec >> entry.size && fields.get() == ' ' && std::getline(fields, relative))
+            {
+                entry.valid = true;
+                entries[relative] = entry;
+            }
+        }
+        return entries;
+    }
+
+    /*
+    Written next to the manifest and renamed over it, an interrupted copy
+    leaves the previous manifest
+    */
+    void WriteManifest(const fs::path& path, const std::vector<tree_file>& files, const std::vector<manifest_entry>& entries)
+    {
+        std::vector<std::size_t> order;
+        for (auto i = std::size_t(0); i < files.size(); ++i)
+        {
+            if (entries[i].valid)
+            {
+                order.push_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return files[a].path < files[b].path; });
+
+        auto temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::trunc);
+            for (auto i : order)
+            {
+                file << std::hex << std::setw(8) << std::setfill('0') << entries[i].checksum << std::dec << ' '
+                    << entries[i].size << ' ' << files[i].path << '\n';
+            }
+            if (!file.flush())
+            {
+                throw std::runtime_error("cannot write " + temporary.string());
+            }
+        }
+        fs::rename(temporary, path);
+    }
+}
+
+tree_listing ScanTree(thread_pool& pool, const std::string& root, const stop_token& token)
+{
+    return tree_scan(pool, root, token).Run();
+}
+
+tree_copy_result CopyTree(thread_pool& pool, const std::string& source, const std::string& destination,
+    const tree_copy_options& options, const stop_token& token)
+{
+    const auto listing = ScanTree(pool, source, token);
+    const auto sourceRoot = fs::path(source);
+    const auto destinationRoot = fs::path(destination);
+
+    // sorted, so every parent exists and is writable before its subdirectories; a read-only directory from an
+    // earlier copy would refuse new entries, its permissions are set again once everything is in it
+    fs::create_directories(destinationRoot);
+    MakeWritable(destinationRoot, fs::status(destinationRoot));
+    for (auto& directory : listing.directories)
+    {
+        fs::create_directory(destinationRoot / directory);
+        MakeWritable(destinationRoot / directory, fs::status(destinationRoot / directory));
+    }
+
+    // a manifest that is not updated would describe files that have since been replaced
+    const auto manifestPath = destinationRoot / TreeCopyManifestName;
+    const auto hashing = options.checksums || options.skip == tree_copy_skip::checksum;
+    const auto previous = hashing ? ReadManifest(manifestPath) : manifest();
+    if (!hashing)
+    {
+        fs::remove(manifestPath);
+    }
+    // every file starts out with what the manifest says about its copy, which stays true until the copy is rewritten
+    std::vector<manifest_entry> entries(listing.files.size());
+    for (auto i = std::size_t(0); i < listing.files.size(); ++i)
+    {
+        const auto old = previous.find(listing.files[i].path);
+        if (old != previous.end())
+        {
+            entries[i] = old->second;
+        }
+    }
+
+    const auto maxWorkers = (options.maxWorkers == 0) ? pool.Size() + 1 : options.maxWorkers;
+    const auto numWorkers = static_cast<unsigned int>(std::max<std::size_t>(1, std::min<std::size_t>(maxWorkers, listing.files.size())));
+    size_scheduler scheduler(listing.files, numWorkers);
+
+    std::atomic<bool> failed(false);
+    std::atomic<std::uint64_t> skipped(0);
+    std::atomic<std::uint64_t> copiedBytes(0);
+    std::array<std::atomic<std::uint64_t>, CopyMethodCount> methods;
+    for (auto& count : methods)
+    {
+        count = 0;
+    }
+    // after an error or a cancel the manifest is still written, the files rewritten so far have new contents
+    try
+    {
+        parallel_for(pool, 0u, numWorkers, 1u, [&](unsigned int first, unsigned int last)
+        {
+            for (auto worker = first; worker < last; ++worker)
+            {
+                try
+                {
+                    while (auto file = scheduler.Next(worker))
+                    {
+                        if (failed)
+                        {
+                            return;
+                        }
+                        token.ThrowIfStopRequested();
+
+                        const auto from = sourceRoot / file->path;
+                        const auto to = destinationRoot / file->path;
+                        auto& entry = entries[static_cast<std::size_t>(file - listing.files.data())];
+                        const auto old = previous.find(file->path);
+                        const auto recorded = (old != previous.end() && old->second.size == file->size) ? old->second : manifest_entry();
+
+                        std::error_code error;
+                        const auto status = fs::status(to, error);
+                        const auto sameSize = fs::is_regular_file(status) && fs::file_size(to) == file->size;
+                        // a copy the manifest has no checksum for (made without checksums) is copied again to get one
+                        if (options.skip != tree_copy_skip::none && sameSize && fs::last_write_time(to) == fs::last_write_time(from)
+                            && (!hashing || recorded.valid))
+                        {
+                            entry = recorded;
+                            ++skipped;
+                            continue;
+                        }
+
+                        // a touched but unchanged file costs one read of the source and no write
+                        if (options.skip == tree_copy_skip::checksum && sameSize && recorded.valid
+                            && FileChecksum(from.string(), token) == recorded.checksum)
+                        {
+                            MakeWritable(to, status);
+                            CopyMetadata(from, to);
+                            entry = recorded;
+                            ++skipped;
+                            continue;
+                        }
+
+                        // the copy stops matching its entry as soon as it is written to
+                        entry = manifest_entry();
+                        if (fs::exists(status))
+                        {
+                            MakeWritable(to, status);
+                        }
+                        file_copy_result copied;
+                        if (hashing)
+                        {
+                            copied = CopyFileWithChecksum(from.string(), to.string(), token);
+                            entry.checksum = copied.checksum;
+                            entry.size = file->size;
+                            entry.valid = true;
+                        }
+                        else if (file->size >= options.chunkedFileSize)
+                        {
+                            copied = CopyFileChunked(pool, from.string(), to.string(), options.chunked, token);
+                        }
+                        else
+                        {
+                            copied = CopyFileZeroCopy(from.string(), to.string(), token);
+                        }
+                        CopyMetadata(from, to);
+                        copiedBytes += file->size;
+                        ++methods[static_cast<std::size_t>(copied.method)];
+                    }
+                }
+                catch (...)
+                {
+                    failed = true;
+                    throw;
+                }
+            }
+        }, token);
+    }
+    catch (...)
+    {
+        if (hashing)
+        {
+            WriteManifest(manifestPath, listing.files, entries);
+        }
+        throw;
+    }
+
+    if (hashing)
+    {
+        WriteManifest(manifestPath, listing.files, entries);
+    }
+
+    for (auto& symlink : listing.symlinks)
+    {
+        const auto to = destinationRoot / symlink;
+        if (fs::is_symlink(fs::symlink_status(to)))
+        {
+            fs::remove(to);
+        }
+        fs::copy_symlink(sourceRoot / symlink, to);
+    }
+
+    // children before parents, setting a parent's time does not touch its children
+    for (auto directory = listing.directories.rbegin(); directory != listing.directories.rend(); ++directory)
+    {
+        CopyMetadata(sourceRoot / *directory, destinationRoot / *directory);
+    }
+    CopyMetadata(sourceRoot, destinationRoot);
+
+    tree_copy_result result;
+    result.files = listing.files.size() - skipped;
+    result.skipped = skipped;
+    result.directories = listing.directories.size();
+    result.bytes = copiedBytes;
+    for (auto method = std::size_t(0); method < CopyMethodCount; ++method)
+    {
+        result.methods[method] = methods[method];
+    }
+    return result;
+}
+
+tree_copy_result CopyTree(const std::string& source, const std::string& destination)
+{
+    return CopyTree(thread_pool::Default(), source, destination);
+}
+
+std::vector<std::string> VerifyTree(thread_pool& pool, const std::string& destination, const stop_token& token)
+{
+    const auto root = fs::path(destination);
+    const auto manifestPath = root / TreeCopyManifestName;
+    if (!fs::exists(manifestPath))
+    {
+        throw std::runtime_error(manifestPath.string() + " does not exist");
+    }
+
+    const auto recorded = ReadManifest(manifestPath);
+    std::vector<const std::pair<const std::string, manifest_entry>*> files;
+    files.reserve(recorded.size());
+    for (auto& file : recorded)
+    {
+        files.push_back(&file);
+    }
+
+    std::mutex mutex;
+    std::vector<std::string> mismatches;
+    parallel_for(pool, std::size_t(0), files.size(), std::size_t(1), [&](std::size_t first, std::size_t last)
+    {
+        for (auto i = first; i < last; ++i)
+        {
+            const auto path = root / files[i]->first;
+            std::error_code error;
+            const auto matches = fs::is_regular_file(fs::status(path, error)) && fs::file_size(path) == files[i]->second.size
+                && FileChecksum(path.string(), token) == files[i]->second.checksum;
+            if (!matches)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                mismatches.push_back(files[i]->first);
+            }
+        }
+    }, token);
+
+    std::sort(mismatches.begin(), mismatches.end());
+    return mismatches;
+}
+
+std::vector<std::string> VerifyTree(const std::string& destination)
+{
+    return VerifyTree(thread_pool::Default(), destination);
+}
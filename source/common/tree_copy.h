@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "file_copy.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+/*
+Copy of a whole directory tree
+
+The tree is listed in parallel: every directory is a task on the pool that
+lists its entries and posts a task for each subdirectory. Tasks posted by a
+worker go to the front of its own queue, so a worker walks its subtree depth
+first while idle workers steal the shallow directories with the most left
+below them.
+
+Splitting the files evenly by count can hand one thread all the large ones, so
+the files are dealt out by size instead: largest first, each to the worker with
+the fewest bytes so far (every file also counts TreeCopyFileCost bytes for
+opening and closing it). A worker copies its own files largest first and, once
+it has none left, steals the smallest file of the worker with the most bytes
+left, which evens out what the estimate got wrong without taking anything big
+from the owner. Files of at least chunkedFileSize are copied with
+CopyFileChunked, so when only a few huge files remain the idle threads help
+with their chunks instead of waiting.
+
+Directories, files and symbolic links are recreated. Permissions and
+modification times of files and directories are copied (directories last, the
+files written into them would change them again); owners and ACLs are not.
+
+Copying again into the same destination can skip what has not changed
+(tree_copy_skip). Files the source no longer has are not removed. With
+checksums the CRC32C of every copied file is computed inline with the copy
+(CopyFileWithChecksum) and kept in a manifest in the destination, which lets
+- tree_copy_skip::checksum skip a file whose time differs but whose contents
+  hash to what was written last time, reading only the source (a file that
+  did change is read a second time by its copy)
+- VerifyTree check the destination against what was written
+A file whose size and time match but that has no checksum in the manifest (the
+last copy was made without checksums) is copied again, so that the manifest
+covers the whole tree. Hashing needs the data in user space, these copies are
+always buffered rather than chunked or zero-copy.
+*/
+
+enum class tree_copy_skip
+{
+    none,          // every file is copied
+    size_and_time, // files whose copy has the same size and modification time are skipped
+    checksum       // as size_and_time, then files whose contents match the manifest as well
+};
+
+struct tree_file
+{
+    std::string path; // relative to the root
+    std::uint64_t size = 0;
+};
+
+struct tree_listing
+{
+    std::vector<std::string> directories; // relative, sorted so parents come first
+    std::vector<tree_file> files;
+    std::vector<std::string> symlinks;
+    std::uint64_t bytes = 0;
+};
+
+struct tree_copy_options
+{
+    std::uint64_t chunkedFileSize = std::uint64_t(256) << 20;
+    file_copy_options chunked;
+    unsigned int maxWorkers = 0; // 0: pool size + 1
+    tree_copy_skip skip = tree_copy_skip::none;
+    bool checksums = false; // always on with tree_copy_skip::checksum
+};
+
+struct tree_copy_result
+{
+    std::uint64_t files = 0;     // copied
+    std::uint64_t skipped = 0;   // unchanged, not written
+    std::uint64_t directories = 0;
+    std::uint64_t bytes = 0;     // copied
+    std::array<std::uint64_t, CopyMethodCount> methods{}; // copied files by the copy_method that moved their data
+};
+
+/*
+Bytes a file counts for on top of its size when files are dealt out
+*/
+constexpr std::uint64_t TreeCopyFileCost = std::uint64_t(64) << 10;
+
+/*
+File in the destination's root holding the checksums
+*/
+constexpr const char* TreeCopyManifestName = ".tree_copy_manifest";
+
+/*
+Lists everything below root, without following symbolic links. Throws
+std::system_error when a directory cannot be read and operation_cancelled when
+the token is stopped.
+*/
+tree_listing ScanTree(thread_pool& pool, const std::string& root, const stop_token& token = stop_token());
+
+/*
+Copies the tree below source into destination, which is created if needed and
+may already exist. Throws std::system_error for the first entry that cannot be
+read or written and operation_cancelled when the token is stopped; the
+destination is left incomplete then, with a manifest that matches what was
+written so far.
+*/
+tree_copy_result CopyTree(thread_pool& pool, const std::string& source, const std::string& destination,
+    const tree_copy_options& options = tree_copy_options(), const stop_token& token = stop_token());
+
+tree_copy_result CopyTree(const std::string& source, const std::string& destination);
+
+/*
+Files recorded in the destination's manifest whose copy is missing or no
+longer matches its size and checksum, sorted. Throws std::runtime_error when
+there is no manifest.
+*/
+std::vector<std::string> VerifyTree(thread_pool& pool, const std::string& destination,
+    const stop_token& token = stop_token());
+
+std::vector<std::string> VerifyTree(const std::string& destination);